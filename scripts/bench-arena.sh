@@ -0,0 +1,105 @@
+#!/usr/bin/env bash
+# ------------------------------------------------------------------------------
+# Measure the TLB and cache misses of ccat with its chunk arena, with the arena
+# on huge pages (-H), and optionally with another ccat binary, such as one
+# built before the arena with its chunks malloc'd one by one.
+#
+# usage: scripts/bench-arena.sh [file] [other ccat] [runs] [ccat options]
+#
+# The counters come from `perf stat` and are the best of `runs` runs, along
+# with the throughput.  Without perf, the page faults of one more run are
+# read from /proc instead, and the TLB and cache misses are not reported.
+# Another run samples /proc for the memory of ccat on huge pages, which shows
+# whether -H got them.  Without a file, 256 MiB of random data are used.
+# ------------------------------------------------------------------------------
+. "$(dirname "$0")/bench-lib.sh"
+
+file=$1
+other=$2
+runs=${3:-3}
+shift $(($# < 3 ? $# : 3))
+opts=("$@")
+events=dTLB-load-misses,dTLB-store-misses,cache-misses,page-faults
+
+need $catprog ${other:+"$other"}
+input "$file" arena.bin random_mib 256
+
+perf=
+if command -v perf > /dev/null &&
+    perf stat -x, -e "$events" true > /dev/null 2>&1; then
+    perf=perf
+fi
+
+# prints the MiB/s and the counters of the best run of the given command
+best_counters() {
+    check "$@"
+    best=
+    for r in $(seq 1 "$runs"); do
+        stats=$tmp/perf
+        start=$(date +%s%N)
+        if [ -n "$perf" ]; then
+            $perf stat -x, -o "$stats" -e "$events" "$@" "$fn" > /dev/null
+        else
+            "$@" "$fn" > /dev/null
+        fi
+        end=$(date +%s%N)
+        t=$((end - start))
+        if [ -z "$best" ] || [ "$t" -lt "$best" ]; then
+            best=$t
+            counters=
+            if [ -n "$perf" ]; then
+                counters=$(awk -F, '$3 != "" { printf " %14s", $1 }' "$stats")
+            fi
+        fi
+        rm -f "$stats"
+    done
+    awk -v s="$size" -v t="$best" \
+        'BEGIN { printf "%10.1f", s / 1048576 / (t / 1e9) }'
+    printf "%s" "$counters"
+}
+
+# prints the page faults of a run of the command, from the counts of the
+# children of a shell that runs it, unless perf counted them, and the most
+# KiB it had on huge pages, sampling /proc while it runs
+proc_counters() {
+    local pid huge=0 h
+
+    if [ -z "$perf" ]; then
+        sh -c '"$@" > /dev/null; read -r s < /proc/$$/stat; set -- $s
+            printf " %14s" $((${11} + ${13}))' sh "$@" "$fn"
+    fi
+    "$@" "$fn" > /dev/null &
+    pid=$!
+    while kill -0 "$pid" 2> /dev/null; do
+        h=$(awk '/^(AnonHugePages|Private_Hugetlb|Shared_Hugetlb):/ {
+                 n += $2 } END { print n + 0 }' \
+            "/proc/$pid/smaps_rollup" 2> /dev/null)
+        if [ "${h:-0}" -gt "$huge" ]; then
+            huge=$h
+        fi
+        sleep 0.01
+    done
+    wait "$pid"
+    printf " %14s\n" "$huge"
+}
+
+# prints a line of the table for the command
+report() {
+    local line
+
+    line=$(best_counters "${@:2}") || exit 1
+    printf "%-24s %s%s\n" "$1" "$line" "$(proc_counters "${@:2}")"
+}
+
+printf "%-24s %10s" binary "MiB/s"
+if [ -n "$perf" ]; then
+    printf " %14s" dTLB-loads dTLB-stores cache page-faults
+else
+    printf " %14s" page-faults
+fi
+printf " %14s\n" "huge KiB"
+report arena $catprog "${opts[@]}"
+report "arena -H" $catprog -H "${opts[@]}"
+if [ -n "$other" ]; then
+    report "$other" "$other" "${opts[@]}"
+fi
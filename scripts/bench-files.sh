@@ -0,0 +1,56 @@
+#!/usr/bin/env bash
+# ------------------------------------------------------------------------------
+# Compare ccat and cat when concatenating many small files.
+#
+# usage: scripts/bench-files.sh [number of files] [runs]
+#
+# Creates a directory with small files of random size (up to 8 KiB) in /tmp
+# and reports the best wall-clock time of `ccat dir/*` and `cat dir/*`.  The
+# page cache is dropped before every run when running as root, otherwise the
+# numbers only reflect the open/stat path with warm caches.
+# ------------------------------------------------------------------------------
+. "$(dirname "$0")/bench-lib.sh"
+
+nfiles=${1:-10000}
+runs=${2:-3}
+dir=/tmp/ccat-bench-files.$nfiles
+
+need $catprog
+
+if [ ! -d "$dir" ]; then
+    mkdir -p "$dir"
+    for i in $(seq -w 1 "$nfiles"); do
+        head -c $((RANDOM % 8192 + 1)) /dev/urandom > "$dir/f$i"
+    done
+fi
+
+if ! $catprog "$dir"/* | cmp -s - <(cat "$dir"/*); then
+    echo "output of $catprog differs from cat"
+    exit 1
+fi
+
+drop_caches() {
+    if [ -w /proc/sys/vm/drop_caches ]; then
+        sync
+        echo 3 > /proc/sys/vm/drop_caches
+    fi
+}
+
+measure() {
+    best=
+    for r in $(seq 1 "$runs"); do
+        drop_caches
+        start=$(date +%s%N)
+        "$@" "$dir"/* > /dev/null
+        end=$(date +%s%N)
+        t=$((end - start))
+        if [ -z "$best" ] || [ "$t" -lt "$best" ]; then
+            best=$t
+        fi
+    done
+    awk -v n="$1" -v t="$best" -v f="$nfiles" \
+        'BEGIN { printf "%-8s %10.1f ms %12.0f files/s\n", n, t / 1e6, f / (t / 1e9) }'
+}
+
+measure cat
+measure $catprog
@@ -0,0 +1,46 @@
+#!/usr/bin/env bash
+# ------------------------------------------------------------------------------
+# Compare ccat with its pass-through mediators fused into the readers (the
+# default without a transform) and with the full pipeline (-F), then a
+# pipeline.h chain of stages with simulated work run by one thread per stage
+# and with the stages fused onto fewer threads.
+#
+# usage: scripts/bench-fusion.sh [file] [runs] [lines] [work]
+#
+# Throughput is the best of `runs` runs over the file, with one reader and with
+# parallel readers; latency is that of `bench.stdin latency` over `lines`
+# interactive lines.  Without a file, 256 MiB of random data are used.  The
+# stages of bench.pipeline.opt share `work` iterations per item.
+# ------------------------------------------------------------------------------
+. "$(dirname "$0")/bench-lib.sh"
+
+benchprog="./bench.stdin"
+runs=${2:-3}
+lines=${3:-1000}
+work=${4:-200}
+
+need $catprog $benchprog ./bench.pipeline.opt
+input "$1" fusion.bin random_mib 256
+
+printf "%12s %12s %12s %10s\n" readers "fused MiB/s" "full MiB/s" speedup
+for j in 1 2; do
+    check $catprog -j "$j"
+    check $catprog -j "$j" -F
+    tf=$(best_of $catprog -j "$j")
+    tu=$(best_of $catprog -j "$j" -F)
+    awk -v j="$j" -v s="$size" -v f="$tf" -v u="$tu" \
+        'BEGIN { m = s / 1048576 * 1e9
+                 printf "%12d %12.1f %12.1f %10.2f\n", j, m / f, m / u, u / f }'
+done
+
+# bench.stdin runs $CCAT without options, wrap ccat -F
+full=$tmp/ccat-full
+printf '#!/bin/sh\nexec %s -F "$@"\n' "$(realpath "$catprog")" > "$full"
+chmod +x "$full"
+
+echo
+echo "fused: $($benchprog latency "$lines")"
+echo "full:  $(CCAT="$full" $benchprog latency "$lines")"
+
+echo
+./bench.pipeline.opt -w "$work" 1-1-1-1 1-1+1-1 1+1+1+1
@@ -0,0 +1,42 @@
+#!/usr/bin/env bash
+# ------------------------------------------------------------------------------
+# Compare the throughput of `ccat -g pattern` with `grep -F pattern`.
+#
+# usage: scripts/bench-grep.sh [file] [pattern] [runs]
+#
+# The outputs are compared first, then the best of `runs` runs is reported in
+# GB/s of input.  Without a file, a 4 GiB log is generated in which about one
+# line in a thousand contains the default pattern.
+# ------------------------------------------------------------------------------
+. "$(dirname "$0")/bench-lib.sh"
+
+pattern=${2:-needle}
+runs=${3:-3}
+
+# writes 1 MiB of numbered lines, one in a thousand with the default pattern
+log_block() {
+    awk 'BEGIN {
+        srand(1)
+        while (length(text) < 200)
+            text = text "lorem ipsum dolor sit amet "
+        for (i = 1; n < 1048576; i++) {
+            s = i " " substr(text, 1, int(rand() * 200))
+            if (rand() < 0.001)
+                s = s " needle"
+            print s
+            n += length(s) + 1
+        }
+    }'
+}
+
+need $catprog
+input "$1" grep.log repeat 4096 log_block
+
+if ! $catprog -g "$pattern" "$fn" | cmp -s - <(grep -F -- "$pattern" "$fn"); then
+    echo "output mismatch" >&2
+    exit 1
+fi
+tc=$(best_of $catprog -g "$pattern")
+tg=$(best_of grep -F -- "$pattern")
+awk -v s="$size" -v c="$tc" -v g="$tg" \
+    'BEGIN { printf "ccat -g %.2f GB/s, grep -F %.2f GB/s\n", s / c, s / g }'
@@ -0,0 +1,89 @@
+# ------------------------------------------------------------------------------
+# Helpers shared by the bench-*.sh scripts, which source this file first:
+#
+#   . "$(dirname "$0")/bench-lib.sh"
+#
+# It prints the usage in the header of the script for -h, and gives the script
+# a temporary directory, $tmp, removed on exit.  The scripts run from the top
+# of the tree, where the binaries are built.
+# ------------------------------------------------------------------------------
+catprog="./ccat"
+
+if [ "$1" = -h ] || [ "$1" = --help ]; then
+    sed -n '3,/^# ---/ { /^# ---/d; s/^# \{0,1\}//; p }' "$0"
+    exit 0
+fi
+
+tmp=$(mktemp -d /tmp/ccat-bench.XXXXXX) || exit 1
+trap 'rm -rf "$tmp"' EXIT
+
+# builds the programs that are missing, or exits
+need() {
+    for p in "$@"; do
+        if [ ! -x "$p" ] && ! make -s "${p#./}" > /dev/null 2>&1; then
+            echo "could not find $p"
+            exit 1
+        fi
+    done
+}
+
+# sets fn to the file $1, or if $1 is empty, to /tmp/ccat-bench-$2, which the
+# command that follows writes to stdout once, and size to its size
+input() {
+    fn=$1
+    if [ -z "$fn" ]; then
+        fn=/tmp/ccat-bench-$2
+        if [ ! -f "$fn" ]; then
+            "${@:3}" > "$tmp/input" && mv "$tmp/input" "$fn" || exit 1
+        fi
+    elif [ ! -f "$fn" ]; then
+        echo "could not find $fn"
+        exit 1
+    fi
+    size=$(wc -c < "$fn")
+}
+
+# writes $1 MiB of random data
+random_mib() {
+    head -c $(($1 * 1024 * 1024)) /dev/urandom
+}
+
+# writes $1 times what the command that follows writes once
+repeat() {
+    "${@:2}" > "$tmp/block" || return 1
+    for i in $(seq 1 "$1"); do
+        cat "$tmp/block"
+    done
+    rm -f "$tmp/block"
+}
+
+# exits unless the command writes the file unchanged
+check() {
+    if ! "$@" "$fn" | cmp -s - "$fn"; then
+        echo "output mismatch with $*" >&2
+        exit 1
+    fi
+}
+
+# prints the time in ns of running the command on the file
+time_of() {
+    local start end
+
+    start=$(date +%s%N)
+    "$@" "$fn" > /dev/null
+    end=$(date +%s%N)
+    echo $((end - start))
+}
+
+# prints the best time in ns of `runs` runs of the command on the file
+best_of() {
+    local best= t
+
+    for r in $(seq 1 "$runs"); do
+        t=$(time_of "$@")
+        if [ -z "$best" ] || [ "$t" -lt "$best" ]; then
+            best=$t
+        fi
+    done
+    echo "$best"
+}
@@ -0,0 +1,53 @@
+#!/usr/bin/env bash
+# ------------------------------------------------------------------------------
+# Measure how the throughput of `ccat -t lz4` scales with the number of
+# mediators, from 1 to the number of cpus.
+#
+# usage: scripts/bench-lz4.sh [file] [runs]
+#
+# If the lz4 tool is installed, the output is decompressed and compared with
+# the input first.  The best of `runs` runs is reported in GB/s of input, with
+# the speedup over a single mediator.  Without a file, a 1 GiB log is
+# generated.
+# ------------------------------------------------------------------------------
+. "$(dirname "$0")/bench-lib.sh"
+
+runs=${2:-3}
+
+# writes 1 MiB of log lines
+log_block() {
+    awk 'BEGIN {
+        srand(1)
+        split("INFO WARN DEBUG ERROR", level, " ")
+        for (i = 1; n < 1048576; i++) {
+            s = sprintf("2026-01-01T00:%02d:%02d.%06d %s worker-%d " \
+                        "request %d took %d us", i / 60 % 60, i % 60,
+                        rand() * 1000000, level[int(rand() * 4) + 1],
+                        rand() * 16, rand() * 100000, rand() * 5000)
+            print s
+            n += length(s) + 1
+        }
+    }'
+}
+
+need $catprog
+input "$1" lz4.log repeat 1024 log_block
+
+if command -v lz4 > /dev/null; then
+    if ! $catprog -t lz4 -m "$(nproc)" "$fn" | lz4 -dc | cmp -s - "$fn"; then
+        echo "output mismatch" >&2
+        exit 1
+    fi
+else
+    echo "lz4 not found, not checking the output" >&2
+fi
+echo "$(basename "$fn"): $size bytes," \
+    "$($catprog -t lz4 "$fn" | wc -c) compressed"
+
+t1=
+for m in $(seq 1 "$(nproc)"); do
+    t=$(best_of $catprog -t lz4 -m "$m")
+    t1=${t1:-$t}
+    awk -v s="$size" -v t="$t" -v t1="$t1" -v m="$m" \
+        'BEGIN { printf "%2d mediators %.2f GB/s, %.2fx\n", m, s / t, t1 / t }'
+done
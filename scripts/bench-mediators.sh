@@ -0,0 +1,47 @@
+#!/usr/bin/env bash
+# ------------------------------------------------------------------------------
+# Measure how ccat scales with the number of mediators (-m).
+#
+# usage: scripts/bench-mediators.sh [file] [max mediators] [work] [runs]
+#
+# Two series are reported.  With `work` iterations of simulated processing per
+# chunk (-w), the mediators are the bottleneck and the speedup should be close
+# to the number of mediators, up to the number of free cores.  Without work,
+# the mediators only pass pointers along, which shows the per-chunk overhead of
+# the lanes and of the reorder buffer; the first line of this series is the
+# original three-ring pipeline.  The mediators are kept (-F) rather than
+# fused into the reader.  Without a file, 64 MiB of random data are
+# used.
+# ------------------------------------------------------------------------------
+. "$(dirname "$0")/bench-lib.sh"
+
+maxm=${2:-8}
+work=${3:-20000}
+runs=${4:-3}
+
+need $catprog
+input "$1" mediators.bin random_mib 64
+chunks=$(((size + 255) / 256))
+
+echo "work = $work iterations per chunk"
+printf "%10s %12s %10s\n" mediators "MiB/s" speedup
+base=
+for m in $(seq 1 "$maxm"); do
+    check $catprog -m "$m" -w "$work"
+    t=$(best_of $catprog -m "$m" -w "$work")
+    if [ -z "$base" ]; then
+        base=$t
+    fi
+    awk -v m="$m" -v s="$size" -v t="$t" -v b="$base" \
+        'BEGIN { printf "%10d %12.1f %10.2f\n", m, s / 1048576 / (t / 1e9), b / t }'
+done
+
+echo
+echo "pass-through"
+printf "%10s %12s %10s\n" mediators "MiB/s" "ns/chunk"
+for m in $(seq 1 "$maxm"); do
+    check $catprog -m "$m" -F
+    t=$(best_of $catprog -m "$m" -F)
+    awk -v m="$m" -v s="$size" -v t="$t" -v c="$chunks" \
+        'BEGIN { printf "%10d %12.1f %10.1f\n", m, s / 1048576 / (t / 1e9), t / c }'
+done
@@ -0,0 +1,45 @@
+#!/usr/bin/env bash
+# ------------------------------------------------------------------------------
+# Compare the throughput of `ccat -n` and `ccat -b` with GNU `cat -n` and
+# `cat -b`.
+#
+# usage: scripts/bench-number.sh [file] [runs]
+#
+# The outputs are compared first, then the best of `runs` runs is reported in
+# GB/s of input.  Without a file, a 64 MiB log with lines of varied length and
+# a few empty lines is generated.
+# ------------------------------------------------------------------------------
+. "$(dirname "$0")/bench-lib.sh"
+
+runs=${2:-3}
+
+# writes 64 MiB of numbered lines, one in twenty empty
+numbered_log() {
+    awk 'BEGIN {
+        srand(1)
+        while (length(text) < 120)
+            text = text "lorem ipsum dolor sit amet "
+        for (i = 1; n < 64 * 1048576; i++) {
+            s = ""
+            if (rand() >= 0.05)
+                s = i " " substr(text, 1, int(rand() * 120))
+            print s
+            n += length(s) + 1
+        }
+    }'
+}
+
+need $catprog
+input "$1" number.log numbered_log
+
+printf "%10s %10s %10s\n" mode ccat cat
+for mode in -n -b; do
+    if ! $catprog $mode "$fn" | cmp -s - <(cat $mode "$fn"); then
+        echo "output mismatch with $mode" >&2
+        exit 1
+    fi
+    tc=$(best_of $catprog $mode)
+    tg=$(best_of cat $mode)
+    awk -v m="$mode" -v s="$size" -v c="$tc" -v g="$tg" \
+        'BEGIN { printf "%10s %10.2f %10.2f GB/s\n", m, s / c, s / g }'
+done
@@ -0,0 +1,31 @@
+#!/usr/bin/env bash
+# ------------------------------------------------------------------------------
+# Measure how ccat scales with the number of parallel pread readers (-j).
+#
+# usage: scripts/bench-readers.sh [file] [max readers] [runs]
+#
+# Without a file, a 256 MiB file of random data is created in /tmp.  Each
+# configuration is checked once against the input and then run several times;
+# the best run is reported so that the numbers reflect the page cache and not
+# the first cold read.
+# ------------------------------------------------------------------------------
+. "$(dirname "$0")/bench-lib.sh"
+
+maxj=${2:-8}
+runs=${3:-3}
+
+need $catprog
+input "$1" readers.bin random_mib 256
+
+printf "%8s %12s %10s\n" readers "MiB/s" speedup
+base=
+for j in $(seq 1 "$maxj"); do
+    check $catprog -j "$j"
+    best=$(best_of $catprog -j "$j")
+    mibs=$(awk -v s="$size" -v t="$best" 'BEGIN { print s / 1048576 / (t / 1e9) }')
+    if [ -z "$base" ]; then
+        base=$mibs
+    fi
+    awk -v j="$j" -v m="$mibs" -v b="$base" \
+        'BEGIN { printf "%8d %12.1f %10.2f\n", j, m, m / b }'
+done
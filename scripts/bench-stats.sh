@@ -0,0 +1,73 @@
+#!/usr/bin/env bash
+# ------------------------------------------------------------------------------
+# Measure the overhead of the live statistics (-DSTATS), against the target of
+# 2%, on the ring buffer benchmark, by comparing bench.opt with bench.stats,
+# and on the whole pipeline, by comparing ccat with ccat.stats.
+#
+# usage: scripts/bench-stats.sh [runs] [file] [options]
+#
+# The binaries run in turn, `runs` times each, and the best op/s, or MiB/s, of
+# each are compared.  The options, such as -W yield, go to all four.  The
+# statistics of the last bench.stats run follow.  The sampler thread needs a
+# cpu of its own for the numbers to mean anything, so fewer cpus than threads
+# are reported.  Without a file, 64 MiB of random data are used.
+# ------------------------------------------------------------------------------
+. "$(dirname "$0")/bench-lib.sh"
+
+runs=${1:-3}
+file=$2
+shift $(($# < 2 ? $# : 2))
+opts=("$@")
+target=2
+
+need ./bench.opt ./bench.stats $catprog ./ccat.stats
+input "$file" stats.bin random_mib 64
+
+# prints the overhead of b over a in %, and whether it is within the target
+overhead() {
+    awk -v a="$1" -v b="$2" -v t="$target" 'BEGIN {
+        if (a <= 0)
+            exit
+        o = 100 * (a - b) / a
+        printf "overhead %.2f%%, %s the %d%% target\n", o,
+               o < t ? "within" : "over", t
+    }'
+}
+
+# bench.stats runs a producer, a consumer and the sampler
+if [ "$(nproc)" -lt 3 ]; then
+    echo "only $(nproc) cpus for 3 threads, the overhead is not meaningful"
+fi
+
+stats=$tmp/stats
+best_opt=0
+best_stats=0
+for r in $(seq 1 "$runs"); do
+    ops=$(./bench.opt "${opts[@]}" 2> /dev/null | awk '/op\/s/ { print $1 }')
+    best_opt=$(awk -v a="$ops" -v b="$best_opt" \
+        'BEGIN { print (a > b ? a : b) }')
+    ops=$(./bench.stats "${opts[@]}" 2> "$stats" |
+        awk '/op\/s/ { print $1 }')
+    best_stats=$(awk -v a="$ops" -v b="$best_stats" \
+        'BEGIN { print (a > b ? a : b) }')
+done
+
+printf "%-12s %14s\n" binary "op/s"
+printf "%-12s %14.2f\n" bench.opt "$best_opt"
+printf "%-12s %14.2f\n" bench.stats "$best_stats"
+overhead "$best_opt" "$best_stats"
+
+check $catprog "${opts[@]}"
+check ./ccat.stats "${opts[@]}" 2> /dev/null
+mibs_cat=$(best_of $catprog "${opts[@]}" |
+    awk -v s="$size" '{ print s / 1048576 / ($1 / 1e9) }')
+mibs_stats=$(best_of ./ccat.stats "${opts[@]}" 2> /dev/null |
+    awk -v s="$size" '{ print s / 1048576 / ($1 / 1e9) }')
+echo
+printf "%-12s %14s\n" binary "MiB/s"
+printf "%-12s %14.1f\n" ccat "$mibs_cat"
+printf "%-12s %14.1f\n" ccat.stats "$mibs_stats"
+overhead "$mibs_cat" "$mibs_stats"
+
+echo
+grep -v '^placement' "$stats"
@@ -0,0 +1,54 @@
+#!/usr/bin/env bash
+# ------------------------------------------------------------------------------
+# Measure the throughput and the cpu time of ccat with each wait policy (-W).
+#
+# usage: scripts/bench-wait.sh [file] [runs] [ccat options]
+#
+# Both are those of the fastest of `runs` runs over the file.  Without a file,
+# 256 MiB of random data are used.  The op/s and the cpu seconds of the ring
+# buffer benchmark, bench.opt, with each policy follow.
+# ------------------------------------------------------------------------------
+. "$(dirname "$0")/bench-lib.sh"
+
+policies="spin relax backoff yield adaptive"
+file=$1
+runs=${2:-3}
+shift $(($# < 2 ? $# : 2))
+opts=("$@")
+
+need $catprog
+input "$file" wait.bin random_mib 256
+
+TIMEFORMAT="%R %U %S"
+
+# prints the MiB/s and the cpu seconds of the fastest run with the policy
+best_cpu() {
+    check $catprog -W "$1" "${opts[@]}"
+    best=
+    for r in $(seq 1 "$runs"); do
+        read -r real user sys < <({ time $catprog -W "$1" "${opts[@]}" \
+            "$fn" > /dev/null; } 2>&1)
+        if [ -z "$best" ] || awk -v t="$real" -v b="$best" \
+            'BEGIN { exit !(t < b) }'; then
+            best=$real
+            cpu=$(awk -v u="$user" -v s="$sys" 'BEGIN { print u + s }')
+        fi
+    done
+    awk -v s="$size" -v t="$best" -v c="$cpu" \
+        'BEGIN { printf "%10.1f %10.2f\n", s / 1048576 / t, c }'
+}
+
+printf "%-10s %10s %10s\n" policy "MiB/s" "cpu s"
+for w in $policies; do
+    line=$(best_cpu "$w") || exit 1
+    printf "%-10s %s\n" "$w" "$line"
+done
+
+if [ -x ./bench.opt ]; then
+    echo
+    printf "%-10s %14s %10s\n" policy "bench.opt op/s" "cpu s"
+    for w in $policies; do
+        ./bench.opt -W "$w" 2> /dev/null | awk -v w="$w" \
+            '/op\/s/ { printf "%-10s %14.2f %10.2f\n", w, $1, $5 }'
+    done
+fi
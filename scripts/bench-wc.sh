@@ -0,0 +1,44 @@
+#!/usr/bin/env bash
+# ------------------------------------------------------------------------------
+# Compare the throughput of `ccat -t wc` with `wc`, with as many mediators as
+# there are cpus, and as many parallel readers as cpus left over.
+#
+# usage: scripts/bench-wc.sh [file] [mediators] [readers] [runs]
+#
+# The counts are compared first, then the best of `runs` runs is reported in
+# GB/s of input.  Without a file, a 4 GiB text file is generated.
+# ------------------------------------------------------------------------------
+. "$(dirname "$0")/bench-lib.sh"
+
+mediators=${2:-$(nproc)}
+readers=${3:-2}
+runs=${4:-3}
+
+# writes 1 MiB of numbered lines of words, tabs and double spaces
+text_block() {
+    awk 'BEGIN {
+        srand(1)
+        while (length(text) < 200)
+            text = text "lorem ipsum dolor sit amet\tconsectetur  "
+        for (i = 1; n < 1048576; i++) {
+            s = i " " substr(text, 1, int(rand() * 200))
+            print s
+            n += length(s) + 1
+        }
+    }'
+}
+
+need $catprog
+input "$1" wc.txt repeat 4096 text_block
+
+ccat_wc="$catprog -t wc -j $readers -m $mediators"
+if [ "$($ccat_wc "$fn" | awk '{ print $1, $2, $3 }')" != \
+     "$(wc < "$fn" | awk '{ print $1, $2, $3 }')" ]; then
+    echo "count mismatch" >&2
+    exit 1
+fi
+tc=$(best_of $ccat_wc)
+tw=$(best_of wc)
+awk -v s="$size" -v c="$tc" -v w="$tw" -v m="$mediators" -v j="$readers" \
+    'BEGIN { printf "ccat -t wc -j %d -m %d %.2f GB/s, wc %.2f GB/s\n",
+             j, m, s / c, s / w }'
@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) Huawei Technologies Co., Ltd. 2026. All rights reserved.
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef ARENA_H
+#define ARENA_H
+/*******************************************************************************
+ * Arena of fixed-size objects carved from a single anonymous mapping.
+ *
+ * Every object starts on a cache line and takes a whole number of them, so
+ * that objects written by different threads never share a line, and the
+ * objects are contiguous, so that a pool of them spans as few pages (and TLB
+ * entries) as possible.  Optionally, the arena is backed by huge pages
+ * (explicit ones if the system has some reserved, transparent ones otherwise),
+ * prefaulted so that the first pass over it does not take page faults, and
+ * locked in memory.
+ *
+ * On NUMA machines, arena_bind() moves a range of objects to the memory of a
+ * node, the one of the thread that writes them, so that its stores do not go
+ * to the other socket.  Binding works on whole pages, a page shared by two
+ * ranges goes to the node of the range bound last.
+ ******************************************************************************/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#define CACHE_LINE 64
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+#define ARENA_HUGE 1     /* back with huge pages if possible */
+#define ARENA_PREFAULT 2 /* touch every page up front */
+#define ARENA_LOCK 4     /* lock in memory, if the limits allow it */
+
+/* from linux/mempolicy.h, without depending on libnuma */
+#define ARENA_MAX_NODES 1024
+#define ARENA_MPOL_PREFERRED 1
+#define ARENA_MPOL_MF_MOVE 2
+
+struct arena {
+    char *base;
+    size_t len;    /* mapped bytes */
+    size_t stride; /* bytes per object, a multiple of CACHE_LINE */
+    unsigned int n;
+    bool huge; /* backed by explicit huge pages */
+};
+
+static inline size_t
+arena_round(size_t n, size_t to)
+{
+    return (n + to - 1) / to * to;
+}
+
+/* maps an arena of n objects of size bytes */
+static inline void
+arena_init(struct arena *a, unsigned int n, size_t size, int flags)
+{
+    void *m = MAP_FAILED;
+
+    a->stride = arena_round(size > 0 ? size : 1, CACHE_LINE);
+    a->n = n;
+    a->len = arena_round(a->stride * (n > 0 ? n : 1),
+                         (size_t)sysconf(_SC_PAGESIZE));
+    a->huge = false;
+
+#ifdef MAP_HUGETLB
+    if (flags & ARENA_HUGE) {
+        size_t len = arena_round(a->len, HUGE_PAGE_SIZE);
+        m = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (m != MAP_FAILED) {
+            a->len = len;
+            a->huge = true;
+        }
+    }
+#endif
+    if (m == MAP_FAILED)
+        m = mmap(NULL, a->len, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (m == MAP_FAILED) {
+        perror("arena mmap");
+        exit(EXIT_FAILURE);
+    }
+#ifdef MADV_HUGEPAGE
+    if ((flags & ARENA_HUGE) && !a->huge)
+        madvise(m, a->len, MADV_HUGEPAGE);
+#endif
+
+    /* anonymous memory is zeroed, writing it faults the pages in */
+    if (flags & ARENA_PREFAULT)
+        memset(m, 0, a->len);
+    if ((flags & ARENA_LOCK) && mlock(m, a->len) != 0)
+        perror("could not lock arena");
+    a->base = (char *)m;
+}
+
+/* returns object i */
+static inline void *
+arena_at(const struct arena *a, unsigned int i)
+{
+    return a->base + (size_t)i * a->stride;
+}
+
+/* binds objects first to first + n - 1 to the memory of node, moving the pages
+ * already faulted in, or leaves them where they are if node is -1 */
+static inline void
+arena_bind(struct arena *a, unsigned int first, unsigned int n, int node)
+{
+#if defined(__linux__) && defined(SYS_mbind)
+    const size_t bits = 8 * sizeof(unsigned long);
+    unsigned long mask[ARENA_MAX_NODES / (8 * sizeof(unsigned long))] = {0};
+    size_t page = a->huge ? HUGE_PAGE_SIZE : (size_t)sysconf(_SC_PAGESIZE);
+    uintptr_t start, end;
+
+    if (node < 0 || node >= ARENA_MAX_NODES || n == 0)
+        return;
+    mask[(size_t)node / bits] = 1UL << ((size_t)node % bits);
+    start = (uintptr_t)arena_at(a, first) / page * page;
+    end = arena_round((uintptr_t)arena_at(a, first + n), page);
+
+    /* preferred rather than bound, a full node falls back to another */
+    if (syscall(SYS_mbind, start, end - start, ARENA_MPOL_PREFERRED, mask,
+                ARENA_MAX_NODES + 1, ARENA_MPOL_MF_MOVE) != 0)
+        perror("could not bind arena");
+#else
+    (void)a;
+    (void)first;
+    (void)n;
+    (void)node;
+#endif
+}
+
+static inline void
+arena_fini(struct arena *a)
+{
+    if (a->base != NULL)
+        munmap(a->base, a->len);
+    a->base = NULL;
+}
+
+#endif
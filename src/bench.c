@@ -11,24 +11,30 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
 #include <unistd.h>
 #include <vsync/atomic.h>
 
+#include "arena.h"
 #include "now.h"
+#include "placement.h"
 
 #ifdef OPTIMIZED
 #include "ringbuf_spsc_opt.h"
 #else
 #include "ringbuf_spsc_sc.h"
 #endif
+#include "stats.h"
+#include "wait.h"
 
 #define CHUNK_SIZE 4
 #define RBUF_SIZE 16
-#define pause()                                                                \
-    if (vatomic32_read_rlx(&stop))                                             \
-        return 0;
-
-void set_cpu(int ci);
+#define pause(w)                                                               \
+    do {                                                                       \
+        if (vatomic32_read_rlx(&stop))                                         \
+            return 0;                                                          \
+        wait_pause(w);                                                         \
+    } while (0)
 
 struct chunk {
     char payload[CHUNK_SIZE];
@@ -45,25 +51,41 @@ vatomic32_t stop;
 /* work count */
 unsigned long consumed;
 
+/* how both threads wait for a ring, set with -W, see wait.h */
+enum wait_policy policy = WAIT_SPIN;
+
+/* producer and consumer cpus, next to each other or with -x on different NUMA
+ * nodes, see placement.h */
+struct placement placement;
+int producer_cpu, consumer_cpu;
+
+/* ring slots and chunks, on the node of the thread that writes them */
+struct arena ring_arena;
+struct arena chunk_arena;
+
 void *
 producer(void *arg)
 {
     struct chunk *c;
-    set_cpu(0);
+    placement_pin(&placement, producer_cpu);
     char data[CHUNK_SIZE];
     int produced = 0;
+    struct waiter w;
 
+    wait_init(&w, policy);
     while (!vatomic32_read_rlx(&stop)) {
         *(int *)data = produced++;
 
-        while (ringbuf_deq(&free_chunks, (void **)&c) != RINGBUF_OK)
-            pause();
+        await_while (ringbuf_deq(&free_chunks, (void **)&c) != RINGBUF_OK)
+            pause(&w);
+        wait_done(&w);
 
         c->len = CHUNK_SIZE;
         memcpy(&c->payload, data, c->len);
 
-        while (ringbuf_enq(&used_chunks, c) != RINGBUF_OK)
-            pause();
+        await_while (ringbuf_enq(&used_chunks, c) != RINGBUF_OK)
+            pause(&w);
+        wait_done(&w);
     }
 
     return 0;
@@ -73,40 +95,118 @@ void *
 consumer(void *arg)
 {
     struct chunk *c = NULL;
+    struct waiter w;
 
-    set_cpu(2);
+    placement_pin(&placement, consumer_cpu);
+    wait_init(&w, policy);
 
     while (!vatomic32_read_rlx(&stop)) {
-        while (ringbuf_deq(&used_chunks, (void **)&c) != RINGBUF_OK)
-            pause();
+        await_while (ringbuf_deq(&used_chunks, (void **)&c) != RINGBUF_OK)
+            pause(&w);
+        wait_done(&w);
 
         consumed++;
 
-        while (ringbuf_enq(&free_chunks, c) != RINGBUF_OK)
-            pause();
+        await_while (ringbuf_enq(&free_chunks, c) != RINGBUF_OK)
+            pause(&w);
+        wait_done(&w);
     }
     return 0;
 }
 
+/* cpu time used by the process so far, in seconds */
+static double
+cpu_time(void)
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_SELF, &ru);
+    return (double)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) +
+           (double)(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
 int
 main(int argc, char *argv[])
 {
-    set_cpu(3);
+    bool cross = false;
+    bool policy_given = false;
+    int flags = 0;
+    int opt;
+
+    /* -I places the threads on isolated cpus, -R runs them with SCHED_FIFO,
+     * -x places the consumer on another node than the producer, -W sets the
+     * wait policy of both */
+    while ((opt = getopt(argc, argv, "IRW:x")) != -1) {
+        switch (opt) {
+        case 'I':
+            flags |= PLACE_ISOLATED;
+            break;
+        case 'R':
+            flags |= PLACE_FIFO;
+            break;
+        case 'W':
+            if (wait_find(optarg) < 0) {
+                fprintf(stderr, "unknown wait policy %s\n", optarg);
+                return 1;
+            }
+            policy = wait_find(optarg);
+            policy_given = true;
+            break;
+        case 'x':
+            cross = true;
+            break;
+        default:
+            printf("usage: %s [-IRx] [-W policy]\n", argv[0]);
+            return 1;
+        }
+    }
+    /* a SCHED_FIFO thread must get off its cpu while it waits, see wait.h */
+    if (flags & PLACE_FIFO) {
+        if (policy_given && !wait_yields(policy)) {
+            fprintf(stderr, "-R needs the yield or adaptive wait policy\n");
+            return 1;
+        }
+        if (!policy_given)
+            policy = WAIT_ADAPTIVE;
+    }
+    placement_init(&placement, flags);
+    producer_cpu = placement_next(&placement, -1);
+    if (cross)
+        consumer_cpu = placement_far(&placement, producer_cpu);
+    else
+        consumer_cpu = placement_next(&placement, producer_cpu);
+    if (consumer_cpu < 0) {
+        fprintf(stderr, "-x needs cpus on two NUMA nodes\n");
+        return 1;
+    }
+    int producer_node = placement_node(&placement, producer_cpu);
+    int consumer_node = placement_node(&placement, consumer_cpu);
+    fprintf(stderr,
+            "placement%s%s: producer %d (node %d) consumer %d (node %d)\n",
+            placement.flags & PLACE_ISOLATED ? " isolated" : "",
+            placement.flags & PLACE_FIFO ? " fifo" : "", producer_cpu,
+            producer_node, consumer_cpu, consumer_node);
+
     int period = 10;
     size_t bsize = sizeof(void *) * RBUF_SIZE;
-    void *buf1 = malloc(bsize);
-    void *buf2 = malloc(bsize);
-    if (!buf1 || !buf2) {
-        perror("buffer malloc");
-        exit(EXIT_FAILURE);
-    }
 
-    ringbuf_init(&free_chunks, buf1, RBUF_SIZE);
-    ringbuf_init(&used_chunks, buf2, RBUF_SIZE);
+    /* each ring on pages of its own, on the node of the thread that
+     * enqueues to it, and the chunks on that of the producer */
+    arena_init(&ring_arena, 2,
+               arena_round(bsize, (size_t)sysconf(_SC_PAGESIZE)),
+               ARENA_PREFAULT);
+    arena_init(&chunk_arena, RBUF_SIZE, sizeof(struct chunk), ARENA_PREFAULT);
+    arena_bind(&ring_arena, 0, 1, consumer_node);
+    arena_bind(&ring_arena, 1, 1, producer_node);
+    arena_bind(&chunk_arena, 0, RBUF_SIZE, producer_node);
+    ringbuf_init(&free_chunks, arena_at(&ring_arena, 0), RBUF_SIZE);
+    ringbuf_init(&used_chunks, arena_at(&ring_arena, 1), RBUF_SIZE);
+    stats_ring_name(&free_chunks, "free");
+    stats_ring_name(&used_chunks, "used");
+    stats_start();
 
     for (int i = 0; i < RBUF_SIZE; i++) {
-        struct chunk *c = (struct chunk *)malloc(sizeof(struct chunk));
-        memset(c, 0, sizeof(struct chunk));
+        struct chunk *c = (struct chunk *)arena_at(&chunk_arena, i);
         if (ringbuf_enq(&free_chunks, c) != RINGBUF_OK) {
             perror("could not create chunks");
             exit(EXIT_FAILURE);
@@ -114,6 +214,7 @@ main(int argc, char *argv[])
     }
 
     pthread_t t1, t2;
+    double cpu_start = cpu_time();
     nanosec_t ts_start = now();
     pthread_create(&t1, 0, producer, 0);
     pthread_create(&t2, 0, consumer, 0);
@@ -125,58 +226,11 @@ main(int argc, char *argv[])
     pthread_join(t2, 0);
 
     double elapsed = in_sec(now() - ts_start);
-    printf("%.2f op/s\t\t%.2fs\n", consumed / elapsed, elapsed);
+    printf("%.2f op/s\t\t%.2fs\t%s %.2f cpu s\n", consumed / elapsed, elapsed,
+           wait_names[policy], cpu_time() - cpu_start);
+    stats_dump(stderr);
+    arena_fini(&chunk_arena);
+    arena_fini(&ring_arena);
+    placement_fini(&placement);
     return 0;
 }
-
-#ifndef SET_CPU_AFFINITY
-
-void
-set_cpu(int id)
-{
-    (void)id;
-}
-
-#elif defined(__linux__)
-
-#if !defined(_GNU_SOURCE)
-#error add "-D_GNU_SOURCE" to your compile command
-#endif
-#include <sched.h>
-#include <sys/sysinfo.h>
-void
-set_cpu(int id)
-{
-    cpu_set_t set;
-    CPU_ZERO(&set);
-    CPU_SET(id, &set);
-
-    if (sched_setaffinity(0, sizeof(set), &set) < 0) {
-        perror("failed to set affinity");
-        exit(EXIT_FAILURE);
-    }
-}
-
-#else /* !__linux__*/
-
-void
-set_cpu(int id)
-{
-    pthread_t pth;
-    cpuset_t *cset;
-    cpuid_t ci = (cpuid_t)id;
-    cset = cpuset_create();
-    if (cset == NULL) {
-        perror("cpuset_create");
-        exit(EXIT_FAILURE);
-    }
-    cpuset_set(ci, cset);
-    pth = pthread_self();
-    if (pthread_setaffinity_np(pth, cpuset_size(cset), cset) != 0) {
-        perror("setaffinity");
-        exit(EXIT_FAILURE);
-    }
-    cpuset_destroy(cset);
-}
-
-#endif
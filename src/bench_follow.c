@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) Huawei Technologies Co., Ltd. 2026. All rights reserved.
+ * SPDX-License-Identifier: MIT
+ */
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "bench_util.h"
+#include "now.h"
+
+#define LINE_SIZE 32
+
+static int
+open_log(const char *fn)
+{
+    int fd = open(fn, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+        perror("could not open log");
+        exit(EXIT_FAILURE);
+    }
+    return fd;
+}
+
+/* appends lines to a log followed by `ccat -f` and measures how long each
+ * line takes to come out of ccat.  Half way, the log is rotated. */
+int
+main(int argc, char *argv[])
+{
+    char *prog = getenv("CCAT") ? getenv("CCAT") : "./ccat";
+    int n = argc >= 2 ? atoi(argv[1]) : 1000;
+    int interval_us = argc >= 3 ? atoi(argv[2]) : 1000;
+    char fn[] = "/tmp/ccat-follow.XXXXXX";
+    char rotated[sizeof(fn) + 2];
+    char line[LINE_SIZE];
+    char back[LINE_SIZE];
+    int out;
+
+    if (n <= 0) {
+        printf("usage: %s [lines] [interval us]\n", argv[0]);
+        return 1;
+    }
+
+    nanosec_t *lat = malloc(sizeof(nanosec_t) * n);
+    int fd = mkstemp(fn);
+    if (lat == NULL || fd < 0) {
+        perror("could not create log");
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+    fd = open_log(fn);
+    snprintf(rotated, sizeof(rotated), "%s.1", fn);
+
+    char *args[] = {prog, "-f", fn, 0};
+    pid_t pid = spawn(args, NULL, &out);
+
+    for (int i = 0; i < n; i++) {
+        if (i == n / 2) {
+            /* rotate: move the log away and start a new one */
+            close(fd);
+            if (rename(fn, rotated) != 0) {
+                perror("could not rotate log");
+                exit(EXIT_FAILURE);
+            }
+            fd = open_log(fn);
+        }
+        snprintf(line, sizeof(line), "%0*d\n", LINE_SIZE - 2, i);
+
+        nanosec_t ts = now();
+        write_all(fd, line, LINE_SIZE);
+        read_all(out, back, LINE_SIZE);
+        lat[i] = now() - ts;
+
+        if (memcmp(line, back, LINE_SIZE) != 0) {
+            fprintf(stderr, "line %d corrupted\n", i);
+            exit(EXIT_FAILURE);
+        }
+        usleep(interval_us);
+    }
+
+    kill(pid, SIGTERM);
+    waitpid(pid, 0, 0);
+    close(fd);
+    unlink(fn);
+    unlink(rotated);
+
+    report_latency(lat, n);
+    free(lat);
+    return 0;
+}
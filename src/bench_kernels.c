@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) Huawei Technologies Co., Ltd. 2026. All rights reserved.
+ * SPDX-License-Identifier: MIT
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "crc32c.h"
+#include "kernels.h"
+#include "now.h"
+#include "transform.h"
+
+#define BUF_SIZE (256 * 1024)
+#define CHUNK 256
+
+enum kernel { MAP, FOLD, ESCAPE, NUMBER, HEX, BASE64, FIND, WC };
+static const char *kernel_names[] = {"map", "fold", "escape", "number",
+                                     "hex", "base64", "find", "wc"};
+
+static char *input;
+static char *work;
+static char *output;
+static struct byte_map map;
+static char pattern[8];
+
+/* runs kernel k of variant v over the input in chunks of CHUNK bytes, as the
+ * mediators do, and returns the output length (the sum of the match offsets
+ * for find, and of the counts for wc) */
+static size_t
+run(const struct kernels *v, enum kernel k)
+{
+    struct number_state number;
+    struct wc_state wc = {.k = v};
+    size_t o = 0;
+
+    number_state_init(&number, v, false);
+    for (size_t i = 0; i < BUF_SIZE; i += CHUNK) {
+        switch (k) {
+        case MAP:
+            v->map(&map, work + i, CHUNK);
+            break;
+        case FOLD:
+            v->fold(work + i, CHUNK, true);
+            break;
+        case ESCAPE:
+            o += v->escape(input + i, CHUNK, output + o);
+            break;
+        case NUMBER:
+            o += number_chunk(&number, input + i, CHUNK, output + o);
+            break;
+        case HEX:
+            v->hex(input + i, CHUNK, output + o);
+            o += 2 * CHUNK;
+            break;
+        case BASE64:
+            /* whole 3-byte groups */
+            v->base64(input + i, CHUNK / 3 * 3, output + o);
+            o += CHUNK / 3 * 4;
+            break;
+        case FIND:
+            for (size_t p = 0, f; p < CHUNK; p += f + 1) {
+                f = v->find(input + i + p, CHUNK - p, pattern, 6);
+                if (f == CHUNK - p)
+                    break;
+                o += i + p + f;
+            }
+            break;
+        case WC:
+            o += wc_chunk(&wc, input + i, CHUNK);
+            break;
+        }
+    }
+    return k >= ESCAPE ? o + wc.lines + wc.words : BUF_SIZE;
+}
+
+/* checks that variant v gives the same result as the scalar kernel */
+static void
+check(const struct kernels *v, enum kernel k)
+{
+    const struct kernels *scalar = &kernel_variants[KERNEL_VARIANTS - 1];
+    char *expect = malloc(4 * BUF_SIZE);
+    size_t n, m;
+
+    if (expect == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(work, input, BUF_SIZE);
+    n = run(scalar, k);
+    if (k < FIND)
+        memcpy(expect, k >= ESCAPE ? output : work, n);
+    memcpy(work, input, BUF_SIZE);
+    m = run(v, k);
+    if (n != m ||
+        (k < FIND && memcmp(expect, k >= ESCAPE ? output : work, n) != 0)) {
+        fprintf(stderr, "%s %s differs from scalar\n", v->isa,
+                kernel_names[k]);
+        exit(EXIT_FAILURE);
+    }
+    free(expect);
+}
+
+int
+main(int argc, char *argv[])
+{
+    int rounds = argc >= 2 ? atoi(argv[1]) : 2000;
+
+    if (rounds <= 0) {
+        printf("usage: %s [rounds]\n", argv[0]);
+        return 1;
+    }
+
+    input = malloc(BUF_SIZE);
+    work = malloc(BUF_SIZE);
+    output = malloc(4 * BUF_SIZE);
+    if (!input || !work || !output) {
+        perror("malloc");
+        return 1;
+    }
+
+    /* printable text with lines of about 60 bytes and one control or
+     * non-ASCII byte every 1000 bytes or so */
+    srand(42);
+    for (size_t i = 0; i < BUF_SIZE; i++) {
+        int r = rand() % 1000;
+        input[i] = (char)(r < 1 ? rand() % 256 : r < 17 ? '\n' : ' ' + r % 95);
+    }
+
+    /* a pattern that occurs at least once */
+    memcpy(pattern, input + 1000, 6);
+
+    /* tr a-z A-Z */
+    byte_map_init(&map);
+    for (int c = 'a'; c <= 'z'; c++)
+        map.table[c] = (unsigned char)(c - 32);
+    byte_map_ranges(&map);
+
+    for (size_t i = 0; i < KERNEL_VARIANTS; i++) {
+        const struct kernels *v = &kernel_variants[i];
+
+        if (!v->supported())
+            continue;
+        for (enum kernel k = MAP; k <= WC; k++) {
+            check(v, k);
+
+            nanosec_t ts = now();
+            for (int r = 0; r < rounds; r++)
+                run(v, k);
+            double elapsed = in_sec(now() - ts);
+
+            printf("%-8s %-8s %.2f GB/s\n", v->isa, kernel_names[k],
+                   (double)BUF_SIZE * rounds / elapsed / 1e9);
+        }
+    }
+
+    /* crc32c of the integrity check, with tables and with instructions */
+    for (int hw = 0; hw < 2; hw++) {
+        crc32c_init(hw);
+        if (hw && !crc32c_accelerated())
+            break;
+
+        nanosec_t ts = now();
+        for (int r = 0; r < rounds; r++)
+            crc32c(0, input, BUF_SIZE);
+        double elapsed = in_sec(now() - ts);
+
+        printf("%-8s %-8s %.2f GB/s\n", hw ? "hw" : "slice8", "crc32c",
+               (double)BUF_SIZE * rounds / elapsed / 1e9);
+    }
+    return 0;
+}
@@ -0,0 +1,243 @@
+/*
+ * Copyright (C) Huawei Technologies Co., Ltd. 2026. All rights reserved.
+ * SPDX-License-Identifier: MIT
+ */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <vsync/atomic.h>
+
+#include "now.h"
+
+#ifdef OPTIMIZED
+#include "ringbuf_spsc_opt.h"
+#else
+#include "ringbuf_spsc_sc.h"
+#endif
+#include "pipeline.h"
+
+#define CHUNK_SIZE 256
+#define MAX_STAGES 16
+
+struct chunk {
+    struct pipeline_item item;
+    char payload[CHUNK_SIZE];
+    size_t len;
+};
+
+/* items to produce, work per item spread over the middle stages, which are
+ * fused away without work unless -F is given */
+static unsigned int items = 1000000;
+static unsigned long work;
+static unsigned long stage_work;
+static volatile unsigned int work_sink;
+static bool unfused;
+
+/* next item of the sources, items seen by the sink */
+static vatomic32_t next;
+static unsigned int consumed;
+
+static bool
+source(void *arg, unsigned int instance, struct pipeline_item *it)
+{
+    struct chunk *c = (struct chunk *)it;
+    unsigned int seq = vatomic32_get_inc_rlx(&next);
+
+    (void)arg;
+    (void)instance;
+    if (seq >= items)
+        return false;
+    it->seq = seq;
+    memcpy(c->payload, &seq, sizeof(seq));
+    c->len = CHUNK_SIZE;
+    return true;
+}
+
+static bool
+middle(void *arg, unsigned int instance, struct pipeline_item *it)
+{
+    struct chunk *c = (struct chunk *)it;
+    unsigned int h = 0;
+
+    (void)arg;
+    (void)instance;
+    for (unsigned long i = 0; !it->eof && i < stage_work; i++)
+        h = h * 31 + (unsigned char)c->payload[i % CHUNK_SIZE];
+    work_sink = h;
+    return true;
+}
+
+/* checks that the items arrive in order and untouched */
+static bool
+sink(void *arg, unsigned int instance, struct pipeline_item *it)
+{
+    struct chunk *c = (struct chunk *)it;
+    unsigned int seq;
+
+    (void)arg;
+    (void)instance;
+    memcpy(&seq, c->payload, sizeof(seq));
+    if (it->seq != consumed || (!it->eof && seq != it->seq)) {
+        fprintf(stderr, "got item %u, expected %u\n", it->seq, consumed);
+        exit(EXIT_FAILURE);
+    }
+    if (!it->eof)
+        consumed++;
+    return true;
+}
+
+/* cpu time used by the process so far, in seconds */
+static double
+cpu_time(void)
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_SELF, &ru);
+    return (double)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) +
+           (double)(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+/* runs the pipeline with the given number of instances per stage, such as
+ * 1-4-1, each optionally followed by the ring variant the stage takes its
+ * items from, as in 1-4:sc-1, and joined to the stage before it by + rather
+ * than - to fuse the two, as in 1-1+1-1, every stage waiting with the given
+ * policy, and returns the elapsed time and the cpu time */
+static double
+run(const char *topology, bool pin, enum wait_policy wait, double *cpu_used)
+{
+    struct stage stages[MAX_STAGES];
+    struct pipeline p = {.stages = stages,
+                         .item_size = sizeof(struct chunk),
+                         .ring_len = 64,
+                         .reorder_len = 128,
+                         .pin = pin,
+                         .arena_flags = ARENA_PREFAULT,
+                         .unfused = unfused};
+    stage_fn fn = work > 0 ? middle : NULL;
+    const char *s = topology;
+    bool fuse = false;
+    char *end;
+
+    while (*s != '\0' && p.nstages < MAX_STAGES) {
+        unsigned long n = strtoul(s, &end, 10);
+        int ring = RING_INCLUDED;
+        char name[16];
+        size_t len;
+
+        if (end == s)
+            break;
+        if (*end == ':') {
+            len = strcspn(end + 1, "-+");
+            snprintf(name, sizeof(name), "%.*s", (int)len, end + 1);
+            if ((ring = ring_find(name)) < 0)
+                break;
+            end += 1 + len;
+        }
+        if (*end != '\0' && *end != '-' && *end != '+')
+            break;
+        stages[p.nstages++] = (struct stage){.name = "middle",
+                                             .fn = fn,
+                                             .instances = (unsigned int)n,
+                                             .cpu = -1,
+                                             .wait = wait,
+                                             .ring = ring,
+                                             .fuse = fuse};
+        fuse = *end == '+';
+        s = *end != '\0' ? end + 1 : end;
+    }
+    if (*s != '\0' || p.nstages < 2) {
+        fprintf(stderr, "bad topology %s\n", topology);
+        exit(EXIT_FAILURE);
+    }
+    stages[0].name = "source";
+    stages[0].fn = source;
+    stages[0].pool = 256;
+    stages[p.nstages - 1].name = "sink";
+    stages[p.nstages - 1].fn = sink;
+    stage_work = p.nstages > 2 ? work / (p.nstages - 2) : 0;
+
+    if (pipeline_init(&p) != 0)
+        exit(EXIT_FAILURE);
+    vatomic32_write(&next, 0);
+    consumed = 0;
+
+    double cs = cpu_time();
+    nanosec_t ts = now();
+    pipeline_run(&p);
+    double elapsed = in_sec(now() - ts);
+    *cpu_used = cpu_time() - cs;
+
+    pipeline_fini(&p);
+    if (consumed != items) {
+        fprintf(stderr, "%s: got %u items, expected %u\n", topology,
+                consumed, items);
+        exit(EXIT_FAILURE);
+    }
+    return elapsed;
+}
+
+int
+main(int argc, char *argv[])
+{
+    static const char *topologies[] = {"1-1",     "1-1-1",   "1-1-1-1-1",
+                                       "1-2-1",   "1-4-1",   "1-2-1-2-1",
+                                       "2-1-4-1", NULL};
+    bool waits[WAIT_POLICIES] = {true, true, true, true, true};
+    bool pin = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "cFn:W:w:")) != -1) {
+        switch (opt) {
+        case 'c':
+            pin = true;
+            break;
+        case 'F':
+            unfused = true;
+            break;
+        case 'n':
+            items = (unsigned int)strtoul(optarg, NULL, 0);
+            break;
+        case 'W':
+            memset(waits, 0, sizeof(waits));
+            for (char *s = strtok(optarg, ","); s != NULL;
+                 s = strtok(NULL, ",")) {
+                int w = wait_find(s);
+                if (w < 0) {
+                    fprintf(stderr, "unknown wait policy %s\n", s);
+                    return 1;
+                }
+                waits[w] = true;
+            }
+            break;
+        case 'w':
+            work = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            printf("usage: %s [-cF] [-n items] [-W policy,...] [-w work] "
+                   "[topology...]\n",
+                   argv[0]);
+            return 1;
+        }
+    }
+
+    const char **list = optind < argc ? (const char **)argv + optind
+                                      : topologies;
+    for (; *list != NULL; list++)
+        for (int w = 0; w < WAIT_POLICIES; w++) {
+            double cpu_used;
+            double elapsed;
+
+            if (!waits[w])
+                continue;
+            elapsed = run(*list, pin, w, &cpu_used);
+            printf("%-12s %-8s %8.2f Mitems/s %8.2f MB/s %8.2f cpu s\n",
+                   *list, wait_names[w], items / elapsed / 1e6,
+                   (double)items * CHUNK_SIZE / elapsed / 1e6, cpu_used);
+        }
+    return 0;
+}
@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) Huawei Technologies Co., Ltd. 2026. All rights reserved.
+ * SPDX-License-Identifier: MIT
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "bench_util.h"
+#include "now.h"
+
+#define LINE_SIZE 32
+#define BULK_WRITE (64 * 1024)
+
+/* writes one short line at a time, as an interactive user would, and measures
+ * how long it takes to come out of ccat */
+static void
+latency(char *prog, int n, int interval_us)
+{
+    char *argv[] = {prog, 0};
+    int in, out;
+    pid_t pid = spawn(argv, &in, &out);
+    nanosec_t *lat = malloc(sizeof(nanosec_t) * n);
+    char line[LINE_SIZE];
+    char back[LINE_SIZE];
+
+    if (lat == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < n; i++) {
+        snprintf(line, sizeof(line), "%0*d\n", LINE_SIZE - 2, i);
+
+        nanosec_t ts = now();
+        write_all(in, line, LINE_SIZE);
+        read_all(out, back, LINE_SIZE);
+        lat[i] = now() - ts;
+
+        if (memcmp(line, back, LINE_SIZE) != 0) {
+            fprintf(stderr, "line %d corrupted\n", i);
+            exit(EXIT_FAILURE);
+        }
+        usleep(interval_us);
+    }
+    close(in);
+    waitpid(pid, 0, 0);
+
+    report_latency(lat, n);
+    free(lat);
+}
+
+struct feeder {
+    int fd;
+    size_t total;
+};
+
+static void *
+feed(void *arg)
+{
+    struct feeder *f = (struct feeder *)arg;
+    char *buf = malloc(BULK_WRITE);
+
+    if (buf == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    memset(buf, 'x', BULK_WRITE);
+
+    for (size_t sent = 0; sent < f->total; sent += BULK_WRITE)
+        write_all(f->fd, buf, BULK_WRITE);
+    close(f->fd);
+    free(buf);
+    return 0;
+}
+
+/* pushes bulk data through ccat's stdin as fast as possible */
+static void
+throughput(char *prog, size_t mib)
+{
+    char *argv[] = {prog, 0};
+    int in, out;
+    pid_t pid = spawn(argv, &in, &out);
+    struct feeder f = {.fd = in, .total = mib * 1024 * 1024};
+    char buf[BULK_WRITE];
+    size_t got = 0;
+    ssize_t r;
+    pthread_t t;
+
+    nanosec_t ts = now();
+    pthread_create(&t, 0, feed, &f);
+    while ((r = read(out, buf, sizeof(buf))) != 0) {
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r < 0) {
+            perror("read");
+            exit(EXIT_FAILURE);
+        }
+        got += (size_t)r;
+    }
+    double elapsed = in_sec(now() - ts);
+    pthread_join(t, 0);
+    waitpid(pid, 0, 0);
+
+    if (got != f.total) {
+        fprintf(stderr, "expected %zu bytes, got %zu\n", f.total, got);
+        exit(EXIT_FAILURE);
+    }
+    printf("%.2f MiB/s\t\t%.2fs\n", mib / elapsed, elapsed);
+}
+
+int
+main(int argc, char *argv[])
+{
+    char *prog = getenv("CCAT") ? getenv("CCAT") : "./ccat";
+
+    signal(SIGPIPE, SIG_IGN);
+
+    if (argc >= 2 && strcmp(argv[1], "latency") == 0) {
+        int n = argc >= 3 ? atoi(argv[2]) : 1000;
+        int interval_us = argc >= 4 ? atoi(argv[3]) : 1000;
+        if (n <= 0) {
+            fprintf(stderr, "invalid number of lines\n");
+            return 1;
+        }
+        latency(prog, n, interval_us);
+    } else if (argc >= 2 && strcmp(argv[1], "throughput") == 0) {
+        int mib = argc >= 3 ? atoi(argv[2]) : 256;
+        if (mib <= 0) {
+            fprintf(stderr, "invalid size\n");
+            return 1;
+        }
+        throughput(prog, (size_t)mib);
+    } else {
+        printf("usage: %s latency [lines] [interval us]\n", argv[0]);
+        printf("       %s throughput [MiB]\n", argv[0]);
+        return 1;
+    }
+    return 0;
+}
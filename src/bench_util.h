@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) Huawei Technologies Co., Ltd. 2026. All rights reserved.
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+/*******************************************************************************
+ * Helpers for benchmark drivers that run ccat as a child process and talk to
+ * it through pipes.
+ ******************************************************************************/
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "now.h"
+
+/* runs argv[0] with pipes connected to its stdin (if in is not NULL) and its
+ * stdout */
+static inline pid_t
+spawn(char *const argv[], int *in, int *out)
+{
+    int pin[2] = {-1, -1}, pout[2];
+
+    if ((in != NULL && pipe(pin) != 0) || pipe(pout) != 0) {
+        perror("pipe");
+        exit(EXIT_FAILURE);
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        exit(EXIT_FAILURE);
+    }
+    if (pid == 0) {
+        if (in != NULL) {
+            dup2(pin[0], STDIN_FILENO);
+            close(pin[0]);
+            close(pin[1]);
+        }
+        dup2(pout[1], STDOUT_FILENO);
+        close(pout[0]);
+        close(pout[1]);
+        execv(argv[0], argv);
+        perror("exec");
+        _exit(EXIT_FAILURE);
+    }
+
+    if (in != NULL) {
+        close(pin[0]);
+        *in = pin[1];
+    }
+    close(pout[1]);
+    *out = pout[0];
+    return pid;
+}
+
+static inline void
+write_all(int fd, const char *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t r = write(fd, buf, len);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r < 0) {
+            perror("write");
+            exit(EXIT_FAILURE);
+        }
+        buf += r;
+        len -= (size_t)r;
+    }
+}
+
+static inline void
+read_all(int fd, char *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t r = read(fd, buf, len);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0) {
+            fprintf(stderr, "ccat output ended early\n");
+            exit(EXIT_FAILURE);
+        }
+        buf += r;
+        len -= (size_t)r;
+    }
+}
+
+static inline int
+cmp_nanosec(const void *a, const void *b)
+{
+    nanosec_t x = *(const nanosec_t *)a;
+    nanosec_t y = *(const nanosec_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+/* sorts the n latency samples in lat and prints a summary */
+static inline void
+report_latency(nanosec_t *lat, int n)
+{
+    nanosec_t sum = 0;
+
+    qsort(lat, n, sizeof(nanosec_t), cmp_nanosec);
+    for (int i = 0; i < n; i++)
+        sum += lat[i];
+    printf("latency (us): min %.1f avg %.1f p50 %.1f p99 %.1f max %.1f\n",
+           (double)lat[0] / NOW_MICROSECOND,
+           (double)sum / n / NOW_MICROSECOND,
+           (double)lat[n / 2] / NOW_MICROSECOND,
+           (double)lat[n * 99 / 100] / NOW_MICROSECOND,
+           (double)lat[n - 1] / NOW_MICROSECOND);
+}
+
+#endif
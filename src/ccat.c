@@ -1,166 +1,1958 @@
 /*
- * Copyright (C) Huawei Technologies Co., Ltd. 2024-2025. All rights reserved.
+ * Copyright (C) Huawei Technologies Co., Ltd. 2024-2026. All rights reserved.
  * SPDX-License-Identifier: MIT
  */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <pthread.h>
+#include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
+#ifdef __linux__
+#include <limits.h>
+#include <sys/inotify.h>
+#endif
 
 #define PAGE_SIZE 4096
 #define CHUNK_SIZE 256
 #define FREE_LEN 64
 #define RBUF_LEN 16
-#define pause()
+#define URING_DEPTH 32
+#define MAX_READERS 64
+#define MAX_MEDIATORS 64
+#define REORDER_LEN 512
+#define LOOKAHEAD 8
+#define PREFETCH_SIZE (16 * PAGE_SIZE)
+#define XFORM_BATCH 16
+#define FOLLOW_POLL_NS 200000000 /* between checks of a file without inotify */
+
+/* the length of what goes through a ring, for the flight recorder, see
+ * item_len() */
+static size_t item_len(const void *q, const void *v);
+#define FLIGHT_LEN(q, v) item_len(q, v)
 
 #include "ringbuf.h"
+#include "arena.h"
+#include "crc32c.h"
+#include "flight.h"
+#include "latency.h"
+#include "now.h"
+#include "pipeline.h"
+#include "placement.h"
+#include "stats.h"
+#include "trace.h"
+#include "transform.h"
+#include "uring.h"
+#include "wait.h"
+
+/* times at which a chunk passes the stages, for -L */
+enum stamp {
+    STAMP_READ,    /* the reader has filled it */
+    STAMP_MEDIATE, /* a mediator has taken it */
+    STAMP_READY,   /* the mediator has passed it to the writer */
+    STAMP_WRITE,   /* the writer has taken it */
+    STAMPS,
+};
 
 struct chunk {
-    char payload[CHUNK_SIZE];
+    struct pipeline_item item; /* seq, eof marker (len is 0) and pool */
+    char *payload;             /* chunk_size bytes in the payload arena */
     size_t len;
+    char *data;       /* payload, or out after an out of place transform */
+    char *out;        /* output buffer of out of place transforms */
+    unsigned int id;  /* index in the items of the pipeline */
+    unsigned int buf; /* fixed buffer index of data */
+    nanosec_t stamp[STAMPS];
 };
 
-/* ring buffers */
-ringbuf_t free_chunks;
-ringbuf_t used_chunks;
-ringbuf_t ready_chunks;
+/* pipeline sizes, they default to the constants above, a host profile written
+ * by -T may change them, and the stress harness varies them from one run to
+ * the next */
+unsigned int chunk_size = CHUNK_SIZE;
+unsigned int block_size = PAGE_SIZE; /* read size, at least chunk_size */
+unsigned int free_len = FREE_LEN;
+unsigned int rbuf_len = RBUF_LEN;
+unsigned int reorder_len = REORDER_LEN; /* a power of two */
 
-/* reader thread reads from the input file chunks */
-void *
-reader(void *arg)
+/* The pipeline, see pipeline.h: the readers fill chunks from their pools,
+ * the mediators transform them and the writer writes them and gives them back
+ * to their pools.  Each thread of the pipeline keeps its worker, with its
+ * waiter, in worker. */
+enum { STAGE_READER, STAGE_MEDIATOR, STAGE_WRITER, NSTAGES };
+struct stage stages[NSTAGES];
+struct pipeline graph;
+__thread struct pipeline_worker *worker;
+
+/* input files, opened ahead of the reader by the opener thread */
+struct input {
+    const char *name;
+    FILE *fp;
+    int err; /* errno if the file could not be opened */
+};
+struct input *inputs;
+unsigned int ninputs;
+ringbuf_t opened_files;
+void *opened_slots[LOOKAHEAD];
+
+/* read buffer of the single reader, block_size bytes */
+char *read_buf;
+
+/* exit status, set if some input file could not be read */
+int status = EXIT_SUCCESS;
+
+/* keep reading the last input file as it grows (-f) */
+bool follow;
+
+/* parallel readers, each with its own chunk pool */
+unsigned int nreaders = 1;
+int input_fd;
+off_t input_size;
+
+/* mediator pool (-m) and simulated work per chunk (-w) */
+unsigned int nmediators = 1;
+unsigned long work;
+volatile unsigned int work_sink;
+
+/* transform applied by the mediators (-t), with one state per mediator */
+const struct transform *xform;
+const char *xform_arg;
+void **xform_states;
+
+/* chunks in a group of a transform with a group, see transform.h */
+unsigned int group_chunks;
+
+/* integrity check (-c): crc of the bytes read, in stream order, and of the
+ * bytes written.  Parallel readers keep one crc per block instead. */
+bool check;
+uint32_t read_crc, write_crc;
+size_t read_bytes, write_bytes;
+uint32_t *block_crc;
+
+/* Chunks live in arenas, see arena.h: the chunk structs are the items of the
+ * pipeline, each on a cache line of its own, and the payloads are in an
+ * arena of their own, away from the fields the threads update.  Out of place
+ * transforms get a third one for their output buffers.  The payloads,
+ * followed by the output buffers if any, are registered as fixed buffers
+ * with io_uring.  -H asks for huge pages.  With placement (-P), the chunks of
+ * each pool are on the NUMA node of the thread that fills them, the output
+ * buffers on that of the mediators, and each ring on that of the thread that
+ * enqueues to it. */
+struct arena payload_arena;
+struct arena out_arena;
+int arena_flags;
+struct iovec *chunk_iov;
+unsigned int nslots; /* number of chunks in all pools */
+
+/* free chunks taken by the reader but not filled with data */
+struct chunk *spare_chunks[URING_DEPTH];
+unsigned int nspare;
+
+/* -T searches the sizes above instead of copying the input */
+bool tuning;
+
+/* How the threads wait for a ring, see wait.h: the opener and the readers
+ * use reader_wait, the mediators mediator_wait and the writer writer_wait,
+ * all set with -W.  The stages -W leaves alone spin, or with -f, which idles
+ * most of the time, and -R, which must not spin, adapt. */
+enum wait_policy reader_wait, mediator_wait, writer_wait;
+bool reader_wait_given, mediator_wait_given, writer_wait_given;
+
+/* Thread placement, see placement.h: -P pins every thread to a cpu, next to
+ * the thread before it in the pipeline, -I to the isolated cpus only and -R
+ * adds SCHED_FIFO.  The pipeline places its threads, and the opener goes
+ * next to the reader.  The cpus are -1 without placement. */
+bool placing;
+int place_flags;
+int opener_cpu;
+
+/* Latency (-L): the hops between the stamps of a chunk go to log-linear
+ * histograms, see latency.h, kept by the thread that ends the hop, the
+ * mediator or the writer, and merged at exit.  Mediators without a loop do
+ * not stamp chunks, so the first hop of the writer then starts at
+ * STAMP_READ. */
+enum hop {
+    HOP_TO_MEDIATOR, /* waiting in a ring for a mediator */
+    HOP_MEDIATOR,    /* batched and transformed */
+    HOP_TO_WRITER,   /* waiting in a ring or the reorder buffer */
+    HOP_WRITER,      /* written */
+    HOP_TOTAL,       /* from the reader to written */
+    HOPS,
+};
+static const char *hop_names[HOPS] = {"to mediator", "mediator", "to writer",
+                                      "writer", "end to end"};
+bool timing;
+__thread struct latency_hist *thread_hops;
+struct latency_hist *hop_hists[MAX_MEDIATORS + 1]; /* HOPS per thread */
+vatomic32_t nhop_hists;
+
+/* gives the calling thread its histograms */
+static void
+hops_init(void)
+{
+    if (!timing)
+        return;
+    thread_hops = calloc(HOPS, sizeof(struct latency_hist));
+    if (thread_hops == NULL) {
+        perror("latency malloc");
+        exit(EXIT_FAILURE);
+    }
+    hop_hists[vatomic32_get_inc(&nhop_hists)] = thread_hops;
+}
+
+static inline void
+stamp(struct chunk *c, enum stamp s)
+{
+    if (timing)
+        c->stamp[s] = now();
+}
+
+/* records hop h of a chunk that went from time from to time to, if it was
+ * stamped at from */
+static inline void
+record_hop(enum hop h, nanosec_t from, nanosec_t to)
+{
+    if (from != 0 && to >= from)
+        latency_record(&thread_hops[h], to - from);
+}
+
+/* the writer is done with chunk c */
+static void
+time_written(struct chunk *c)
+{
+    nanosec_t t, *st = c->stamp;
+
+    if (!timing || c->item.eof)
+        return;
+    t = now();
+    record_hop(HOP_TO_WRITER,
+               st[STAMP_READY] ? st[STAMP_READY] : st[STAMP_READ],
+               st[STAMP_WRITE]);
+    record_hop(HOP_WRITER, st[STAMP_WRITE], t);
+    record_hop(HOP_TOTAL, st[STAMP_READ], t);
+}
+
+/* merges the histograms of the threads and prints them */
+static void
+print_latency(void)
+{
+    struct latency_hist *total = calloc(HOPS, sizeof(struct latency_hist));
+    unsigned int n = vatomic32_read(&nhop_hists);
+
+    if (total == NULL) {
+        perror("latency malloc");
+        exit(EXIT_FAILURE);
+    }
+    for (unsigned int i = 0; i < n; i++)
+        for (unsigned int h = 0; h < HOPS; h++)
+            latency_merge(&total[h], &hop_hists[i][h]);
+    latency_header(stderr);
+    for (unsigned int h = 0; h < HOPS; h++)
+        if (total[h].count > 0)
+            latency_print(stderr, hop_names[h], &total[h]);
+    free(total);
+}
+
+/* -X writes a trace of the threads to trace_path at exit, see trace.h.  The
+ * thread waiters hold the buffers, and the reader, the mediators and the
+ * writer add their system calls and batches to them. */
+const char *trace_path;
+
+/* The flight recorder, see flight.h, keeps the last ring operations of every
+ * thread and dumps them to dump_path, or stderr, on SIGABRT, SIGQUIT, a failed
+ * integrity check, or with -d after watchdog seconds without progress. */
+const char *dump_path;
+unsigned int watchdog;
+
+/* all rings but that of the opened files hold chunks */
+static size_t
+item_len(const void *q, const void *v)
+{
+    return q == &opened_files ? 0 : ((const struct chunk *)v)->len;
+}
+
+/* takes a chunk from the pool of the calling thread without blocking */
+static bool
+new_chunk(struct chunk **c)
+{
+    struct pipeline_item *it;
+
+    if (!pipeline_new(worker, &it))
+        return false;
+    *c = (struct chunk *)it;
+    return true;
+}
+
+/* gets a free chunk without blocking, returns false if none is available */
+static bool
+try_get_free(struct chunk **c)
 {
-    FILE *fp = fopen((const char *)arg, "r");
-    if (fp == NULL) {
-        perror("could not open file");
+    if (nspare > 0) {
+        *c = spare_chunks[--nspare];
+        return true;
+    }
+    return new_chunk(c);
+}
+
+/* passes chunk ownership from the single reader to mediator, the pipeline
+ * numbers it */
+static void
+put_used(struct chunk *c)
+{
+    if (check) {
+        read_crc = crc32c(read_crc, c->payload, c->len);
+        read_bytes += c->len;
+    }
+
+    stamp(c, STAMP_READ);
+    pipeline_pass(worker, &c->item);
+}
+
+/* sets up the reader's io_uring, returns false if it is not available */
+static bool
+uring_setup(struct uring *u)
+{
+    if (uring_init(u, URING_DEPTH) < 0)
+        return false;
+    unsigned int n = xform && xform->bound ? 2 * nslots : nslots;
+
+    if (uring_register_buffers(u, chunk_iov, n) < 0) {
+        uring_fini(u);
+        return false;
+    }
+    return true;
+}
+
+/* queues the read of the rest of chunk c, from file offset at, in slot */
+static void
+queue_read(struct uring *u, int fd, struct chunk *c, off_t at,
+           unsigned int slot)
+{
+    int r;
+
+    /* with the sq full, submit what is queued to make room */
+    while ((r = uring_prep_rw(u, IORING_OP_READ_FIXED, fd,
+                              c->payload + c->len,
+                              (unsigned int)(chunk_size - c->len), at, c->id,
+                              slot, 0)) == -EAGAIN)
+        if ((r = uring_submit(u, 0)) < 0)
+            break;
+    if (r < 0) {
+        errno = -r;
+        perror("could not queue a read");
         exit(EXIT_FAILURE);
     }
+}
+
+/* reads a regular file of the given size with up to URING_DEPTH reads in
+ * flight.  Reads are only queued ahead up to the expected end of file, past
+ * that we read one chunk at a time until one returns nothing.  A short read
+ * before the end of file, which a signal or a file system may cause, is
+ * resubmitted for the rest of its chunk. */
+static void
+reader_uring(struct uring *u, int fd, off_t size)
+{
+    struct io_uring_cqe cqe[URING_DEPTH];
+    struct chunk *inflight[URING_DEPTH];
+    off_t start[URING_DEPTH]; /* file offset of the chunk */
+    bool done[URING_DEPTH];
+    unsigned int head = 0; /* oldest read not yet passed to mediator */
+    unsigned int tail = 0; /* next read to submit */
+    off_t off = 0;
+    bool eof = false;
+    struct chunk *c;
+
+    while (!eof || head != tail) {
+        /* keep reads queued into every free chunk we can get */
+        while (!eof && tail - head < URING_DEPTH &&
+               (off <= size || head == tail) && try_get_free(&c)) {
+            unsigned int slot = tail % URING_DEPTH;
+            c->len = 0;
+            queue_read(u, fd, c, off, slot);
+            inflight[slot] = c;
+            start[slot] = off;
+            done[slot] = false;
+            off += chunk_size;
+            tail++;
+        }
+        if (head == tail) {
+            wait_pause(&worker->wait);
+            continue;
+        }
+        wait_done(&worker->wait);
+
+        /* submit new reads and reap completions in batches */
+        trace_begin(worker->wait.trace, TRACE_SUBMIT, 1);
+        int r = uring_submit(u, 1);
+        trace_end(worker->wait.trace, TRACE_SUBMIT);
+        if (r < 0) {
+            errno = -r;
+            perror("could not submit reads");
+            exit(EXIT_FAILURE);
+        }
+        unsigned int n = uring_reap(u, cqe, URING_DEPTH);
+        for (unsigned int i = 0; i < n; i++) {
+            if (cqe[i].res < 0) {
+                errno = -cqe[i].res;
+                perror("could not read file");
+                exit(EXIT_FAILURE);
+            }
+            unsigned int slot = (unsigned int)cqe[i].user_data;
+            off_t at;
+
+            c = inflight[slot];
+            c->len += (size_t)cqe[i].res;
+            at = start[slot] + (off_t)c->len;
+            if (cqe[i].res > 0 && c->len < chunk_size && at < size) {
+                queue_read(u, fd, c, at, slot);
+                continue;
+            }
+            done[slot] = true;
+        }
+
+        /* pass ownership of completed chunks to mediator in file order */
+        while (head != tail && done[head % URING_DEPTH]) {
+            c = inflight[head++ % URING_DEPTH];
+
+            /* a chunk is only short at the end of file, and those read
+             * after it are past it */
+            if (eof || c->len == 0) {
+                eof = true;
+                spare_chunks[nspare++] = c;
+                continue;
+            }
+            if (c->len < chunk_size)
+                eof = true;
+
+            put_used(c);
+        }
+    }
+}
+
+/* opens the input files ahead of the reader and prefetches their first pages,
+ * at most LOOKAHEAD files are waiting for the reader at any time */
+void *
+opener(void *arg)
+{
+    struct waiter wait;
+
+    wait_init(&wait, reader_wait);
+    wait_track(&wait, "opener", 0);
+    flight_thread("opener", 0);
+    if (opener_cpu >= 0)
+        placement_pin(&graph.placement, opener_cpu);
+    for (unsigned int i = 0; i < ninputs; i++) {
+        struct input *in = &inputs[i];
+
+        if (strcmp(in->name, "-") == 0)
+            in->fp = stdin;
+        else
+            in->fp = fopen(in->name, "r");
+        if (in->fp == NULL)
+            in->err = errno;
+#ifdef POSIX_FADV_WILLNEED
+        else if (in->fp != stdin)
+            posix_fadvise(fileno(in->fp), 0, PREFETCH_SIZE,
+                          POSIX_FADV_WILLNEED);
+#endif
+
+        wait_while(&wait, ringbuf_enq(&opened_files, in) != RINGBUF_OK);
+    }
+    wait_untrack(&wait);
+    return 0;
+}
 
-    char data[PAGE_SIZE];
+/* splits read data in chunks and passes them to the mediator */
+static void
+pass_data(const char *data, size_t r)
+{
     struct chunk *c;
+
+    for (size_t i = 0; i < r;) {
+        /* get a free chunk */
+        wait_while(&worker->wait, !try_get_free(&c));
+
+        /* calculate available data length and copy */
+        c->len = r - i > chunk_size ? chunk_size : r - i;
+        memcpy(c->payload, data + i, c->len);
+        i += c->len;
+
+        /* pass ownership of c to mediator */
+        put_used(c);
+    }
+}
+
+/* returns true if a read on fd would not block */
+static bool
+input_pending(int fd)
+{
+    struct pollfd pfd = {.fd = fd, .events = POLLIN};
+    return poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLIN);
+}
+
+/* reads a pipe, terminal or socket.  The read size grows towards block_size
+ * while reads come back full and shrinks towards chunk_size when they come
+ * back short.  A partial chunk is held back while more input is already
+ * pending, so that a trickle of short reads does not become a stream of
+ * partially-filled chunks, and passed on as soon as the input goes quiet. */
+static void
+read_stream(FILE *fp)
+{
+    char *data = read_buf;
+    size_t fill = 0;          /* bytes in data not passed on yet */
+    size_t want = chunk_size; /* current read size */
+    int fd = fileno(fp);
+
+    for (;;) {
+        size_t req = want < block_size - fill ? want : block_size - fill;
+        trace_begin(worker->wait.trace, TRACE_READ, (uint32_t)req);
+        ssize_t r = read(fd, data + fill, req);
+        trace_end(worker->wait.trace, TRACE_READ);
+
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r < 0) {
+            perror("could not read");
+            status = EXIT_FAILURE;
+            break;
+        }
+        if (r == 0)
+            break;
+
+        if ((size_t)r == req && want < block_size)
+            want *= 2;
+        else if ((size_t)r < req / 2 && want > chunk_size)
+            want /= 2;
+
+        /* pass whole chunks on, and the tail if no more input is pending */
+        size_t out = fill + (size_t)r;
+        size_t tail = out % chunk_size;
+        if (tail != 0 && !input_pending(fd))
+            tail = 0;
+        pass_data(data, out - tail);
+        memmove(data, data + out - tail, tail);
+        fill = tail;
+    }
+
+    pass_data(data, fill);
+}
+
+/* reads fd up to its current end of file */
+static void
+read_to_end(int fd)
+{
+    ssize_t r;
+
+    for (;;) {
+        trace_begin(worker->wait.trace, TRACE_READ, block_size);
+        r = read(fd, read_buf, block_size);
+        trace_end(worker->wait.trace, TRACE_READ);
+        if (r == 0)
+            break;
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r < 0) {
+            perror("could not read");
+            status = EXIT_FAILURE;
+            return;
+        }
+        pass_data(read_buf, (size_t)r);
+    }
+}
+
+#ifdef __linux__
+/* reads a file and then whatever is appended to it, never sending the end of
+ * file marker.  Instead of polling, the reader sleeps on inotify events of the
+ * file and of its directory.  When the file is moved away or deleted (log
+ * rotation), the rest of the old file is read and the name is reopened as
+ * soon as a new file appears.  A truncated file is read again from the top.
+ * If the file cannot be watched, as when inotify runs out of watches, the
+ * reader checks the file and its name every FOLLOW_POLL_NS instead. */
+static void
+follow_file(struct input *in)
+{
+    char buf[sizeof(struct inotify_event) + NAME_MAX + 1]
+        __attribute__((aligned(__alignof__(struct inotify_event))));
+    char dir[PATH_MAX];
+    const char *base = strrchr(in->name, '/');
+    int fd = dup(fileno(in->fp));
+    bool rotated = false;
+    struct stat st, nst;
+
+    /* split the name in directory and base name */
+    if (base == NULL) {
+        strcpy(dir, ".");
+        base = in->name;
+    } else {
+        snprintf(dir, sizeof(dir), "%.*s", (int)(base - in->name), in->name);
+        if (dir[0] == 0)
+            strcpy(dir, "/");
+        base++;
+    }
+
+    if (fd < 0) {
+        perror("could not follow file");
+        status = EXIT_FAILURE;
+        read_to_end(fileno(in->fp));
+        return;
+    }
+    int ino = inotify_init1(IN_CLOEXEC);
+    int wfile = -1, wdir = -1;
+    if (ino >= 0) {
+        wfile = inotify_add_watch(ino, in->name,
+                                  IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF |
+                                      IN_DELETE_SELF);
+        wdir = inotify_add_watch(ino, dir, IN_CREATE | IN_MOVED_TO);
+    }
+    bool polling = wfile < 0 || wdir < 0;
+    if (polling)
+        perror("could not watch file, polling it");
+
+    for (;;) {
+        read_to_end(fd);
+
+        /* truncated in place, start over */
+        if (fstat(fd, &st) == 0 && st.st_size < lseek(fd, 0, SEEK_CUR)) {
+            lseek(fd, 0, SEEK_SET);
+            continue;
+        }
+
+        /* rotated and the new file is there, switch to it.  Without
+         * inotify, the name is checked every time. */
+        if (rotated || polling) {
+            int nfd = open(in->name, O_RDONLY);
+            if (nfd >= 0 && fstat(nfd, &nst) == 0 &&
+                (nst.st_ino != st.st_ino || nst.st_dev != st.st_dev)) {
+                close(fd);
+                fd = nfd;
+                rotated = false;
+                if (polling)
+                    continue;
+                inotify_rm_watch(ino, wfile);
+                wfile = inotify_add_watch(ino, in->name,
+                                          IN_MODIFY | IN_ATTRIB |
+                                              IN_MOVE_SELF | IN_DELETE_SELF);
+                if (wfile < 0) {
+                    perror("could not watch file, polling it");
+                    polling = true;
+                }
+                continue;
+            }
+            if (nfd >= 0)
+                close(nfd);
+        }
+
+        if (polling) {
+            nanosleep(&(struct timespec){0, FOLLOW_POLL_NS}, NULL);
+            continue;
+        }
+
+        /* sleep until something happens to the file or its name */
+        ssize_t r = read(ino, buf, sizeof(buf));
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0) {
+            perror("could not wait for file changes");
+            status = EXIT_FAILURE;
+            break;
+        }
+        for (char *p = buf; p < buf + r;) {
+            struct inotify_event *ev = (struct inotify_event *)p;
+            if (ev->wd == wfile &&
+                (ev->mask & (IN_MOVE_SELF | IN_DELETE_SELF)))
+                rotated = true;
+            if (ev->wd == wdir && ev->len > 0 && strcmp(ev->name, base) == 0)
+                rotated = true;
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+    if (ino >= 0)
+        close(ino);
+    close(fd);
+}
+#else
+static void
+follow_file(struct input *in)
+{
+    fprintf(stderr, "follow mode needs inotify\n");
+    status = EXIT_FAILURE;
+    read_to_end(fileno(in->fp));
+}
+#endif
+
+/* reads one file in chunks and passes them to the mediator */
+static void
+read_file(struct uring *u, FILE *fp)
+{
     size_t r;
+    struct stat st;
+
+    if (fstat(fileno(fp), &st) == 0 && !S_ISREG(st.st_mode)) {
+        read_stream(fp);
+        return;
+    }
+    if (u != NULL) {
+        reader_uring(u, fileno(fp), st.st_size);
+        return;
+    }
 
     do {
         /* read large portion of data */
-        r = fread(&data, 1, PAGE_SIZE, fp);
+        trace_begin(worker->wait.trace, TRACE_READ, block_size);
+        r = fread(read_buf, 1, block_size, fp);
+        trace_end(worker->wait.trace, TRACE_READ);
+        pass_data(read_buf, r);
+    } while (r != 0);
+}
 
-        /* split read data in chunks */
-        for (size_t i = 0; i < r;) {
-            /* get a free chunk */
-            while (ringbuf_deq(&free_chunks, (void **)&c) != RINGBUF_OK)
-                pause();
+/* reader thread reads the input files in chunks */
+static void
+reader(struct pipeline_worker *w)
+{
+    struct uring u;
+    bool uring = uring_setup(&u);
+    struct chunk *c;
 
-            /* calculate available data length and copy */
-            c->len = r - i > CHUNK_SIZE ? CHUNK_SIZE : r - i;
-            memcpy(&c->payload, data + i, c->len);
-            i += c->len;
+    worker = w;
+    flight_thread("reader", 0);
+    if ((read_buf = malloc(block_size)) == NULL) {
+        perror("reader malloc");
+        exit(EXIT_FAILURE);
+    }
+    for (unsigned int i = 0; i < ninputs; i++) {
+        struct input *in;
+
+        /* get the next file from the opener */
+        wait_while(&w->wait,
+                   ringbuf_deq(&opened_files, (void **)&in) != RINGBUF_OK);
 
-            /* pass ownership of c to mediator */
-            while (ringbuf_enq(&used_chunks, c) != RINGBUF_OK)
-                pause();
+        if (in->fp == NULL) {
+            fprintf(stderr, "could not open %s: %s\n", in->name,
+                    strerror(in->err));
+            status = EXIT_FAILURE;
+            continue;
         }
 
-    } while (r != 0);
+        if (follow && i == ninputs - 1 && in->fp != stdin)
+            follow_file(in);
+        else
+            read_file(uring ? &u : NULL, in->fp);
+        if (in->fp != stdin)
+            fclose(in->fp);
+    }
 
-    fclose(fp);
+    if (uring)
+        uring_fini(&u);
+    free(read_buf);
 
     /* send empty chunk to mark end of file */
-    while (ringbuf_deq(&free_chunks, (void **)&c) != RINGBUF_OK)
-        pause();
+    wait_while(&w->wait, !try_get_free(&c));
     c->len = 0;
+    pipeline_end(w, &c->item);
+}
 
-    while (ringbuf_enq(&used_chunks, c) != RINGBUF_OK)
-        pause();
-    return 0;
+/* reads blocks id, id + K, id + 2K, ... of the input file with pread */
+static void
+range_reader(struct pipeline_worker *w)
+{
+    char *data = malloc(block_size);
+    struct chunk *c;
+
+    worker = w;
+    flight_thread("reader", w->instance);
+    if (data == NULL) {
+        perror("reader malloc");
+        exit(EXIT_FAILURE);
+    }
+    for (off_t off = (off_t)w->instance * block_size; off < input_size;
+         off += (off_t)nreaders * block_size) {
+        size_t len = input_size - off > block_size ? block_size
+                                                   : (size_t)(input_size - off);
+
+        /* read a whole block, the file size is known */
+        for (size_t got = 0; got < len;) {
+            trace_begin(worker->wait.trace, TRACE_READ, (uint32_t)(len - got));
+            ssize_t n = pread(input_fd, data + got, len - got, off + got);
+            trace_end(worker->wait.trace, TRACE_READ);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0) {
+                perror("could not read file");
+                exit(EXIT_FAILURE);
+            }
+            if (n == 0) {
+                fprintf(stderr, "file shrank while reading\n");
+                exit(EXIT_FAILURE);
+            }
+            got += (size_t)n;
+        }
+        if (check)
+            block_crc[off / block_size] = crc32c(0, data, len);
+
+        /* split read data in chunks numbered by their file offset, the
+         * pipeline does not let them run further ahead of the writer than
+         * the reorder buffer allows, whatever the other readers are doing */
+        for (size_t i = 0; i < len;) {
+            wait_while(&w->wait, !new_chunk(&c));
+
+            c->len = len - i > chunk_size ? chunk_size : len - i;
+            c->item.seq = (unsigned int)((off + i) / chunk_size);
+            memcpy(c->payload, data + i, c->len);
+            i += c->len;
+
+            stamp(c, STAMP_READ);
+            pipeline_pass(w, &c->item);
+        }
+    }
+
+    /* the last reader to finish sends an empty chunk to mark end of file */
+    free(data);
+    wait_while(&w->wait, !new_chunk(&c));
+    c->len = 0;
+    pipeline_end(w, &c->item);
 }
 
-/* consumes read chunks, maybe does some magic, and passes chunk to write */
-void *
-mediator(void *arg)
+/* gets a chunk from the reader(s) without blocking */
+static bool
+get_used(struct chunk **c)
+{
+    struct pipeline_item *it;
+
+    if (!pipeline_get(worker, &it))
+        return false;
+    *c = (struct chunk *)it;
+    stamp(*c, STAMP_MEDIATE);
+    return true;
+}
+
+/* waits for a chunk from the reader(s), returns false once the writer is
+ * done */
+static bool
+take_used(struct chunk **c)
+{
+    struct pipeline_item *it;
+
+    if (!pipeline_take(worker, &it))
+        return false;
+    *c = (struct chunk *)it;
+    stamp(*c, STAMP_MEDIATE);
+    return true;
+}
+
+/* passes chunk ownership to writer */
+static void
+put_ready(struct chunk *c)
 {
+    if (timing && !c->item.eof) {
+        stamp(c, STAMP_READY);
+        record_hop(HOP_TO_MEDIATOR, c->stamp[STAMP_READ],
+                   c->stamp[STAMP_MEDIATE]);
+        record_hop(HOP_MEDIATOR, c->stamp[STAMP_MEDIATE],
+                   c->stamp[STAMP_READY]);
+    }
+    pipeline_pass(worker, &c->item);
+}
+
+/* gets a chunk ready to be written without blocking */
+static bool
+get_ready(struct chunk **c)
+{
+    struct pipeline_item *it;
+
+    if (!pipeline_get(worker, &it))
+        return false;
+    *c = (struct chunk *)it;
+    stamp(*c, STAMP_WRITE);
+    return true;
+}
+
+/* gives chunk ownership back to its pool */
+static void
+put_free(struct chunk *c)
+{
+    c->data = c->payload;
+    c->buf = c->id;
+    if (timing)
+        memset(c->stamp, 0, sizeof(c->stamp));
+    pipeline_release(worker, &c->item);
+}
+
+/* simulates CPU-heavy processing of a chunk, used to benchmark the pool */
+static void
+burn(struct chunk *c, unsigned long n)
+{
+    unsigned int h = 0;
+
+    for (unsigned long i = 0; i < n; i++)
+        h = h * 31 + (unsigned char)c->payload[i % chunk_size];
+    work_sink = h;
+}
+
+/* applies the transform to a batch of chunks.  Out of place output goes to
+ * the chunk's output buffer, which then becomes the data to write. */
+static void
+transform_chunks(void *state, struct chunk **batch, unsigned int n)
+{
+    struct span in[XFORM_BATCH], out[XFORM_BATCH];
+    struct span *dst = xform->bound ? out : in;
+    struct chunk *data[XFORM_BATCH];
+    unsigned int k = 0;
+
+    for (unsigned int i = 0; i < n; i++) {
+        if (batch[i]->item.eof)
+            continue;
+        data[k] = batch[i];
+        in[k] = (struct span){.data = batch[i]->payload,
+                              .len = batch[i]->len,
+                              .seq = batch[i]->item.seq};
+        out[k] = (struct span){.data = batch[i]->out, .len = 0};
+        k++;
+    }
+    if (k > 0)
+        xform->process(state, in, dst, k);
+
+    for (unsigned int i = 0; i < k; i++) {
+        data[i]->len = dst[i].len;
+        if (xform->bound) {
+            data[i]->data = data[i]->out;
+            data[i]->buf = nslots + data[i]->id;
+        }
+    }
+}
+
+/* applies a transform with a group to the n chunks of a group, the last one
+ * may be the end of file marker.  Every chunk gets its share of the output in
+ * its output buffer.  in and out have room for a group and a marker. */
+static void
+transform_group(void *state, struct chunk **group, unsigned int n,
+                struct span *in, struct span *out)
+{
+    for (unsigned int i = 0; i < n; i++) {
+        in[i] = (struct span){.data = group[i]->payload,
+                              .len = group[i]->len,
+                              .seq = group[i]->item.seq,
+                              .eof = group[i]->item.eof};
+        out[i] = (struct span){.data = group[i]->out, .len = 0};
+    }
+    xform->process(state, in, out, n);
+
+    for (unsigned int i = 0; i < n; i++) {
+        group[i]->len = out[i].len;
+        group[i]->data = group[i]->out;
+        group[i]->buf = nslots + group[i]->id;
+    }
+}
+
+/* passes the output that the transform flushes on to the writer in spill
+ * chunks.  A spill chunk that was not needed is kept in *spare. */
+static void
+spill(void *state, struct chunk **spare, bool eof)
+{
+    size_t room = xform->bound ? xform->bound(chunk_size) : chunk_size;
+
+    for (;;) {
+        struct chunk *c = *spare;
+
+        if (c == NULL)
+            wait_while(&worker->wait, !new_chunk(&c));
+        if (xform->bound) {
+            c->data = c->out;
+            c->buf = nslots + c->id;
+        }
+        c->len = xform->flush(state, c->data, room, eof);
+        if (c->len == 0) {
+            *spare = c;
+            return;
+        }
+        *spare = NULL;
+        put_ready(c);
+    }
+}
+
+/* consumes read chunks, transforms them in batches, and passes them to write.
+ * The flushed output goes to spill chunks of the mediator's own pool. */
+static void
+mediator(struct pipeline_worker *w)
+{
+    unsigned int id = w->instance;
+    void *state = xform ? xform_states[id] : NULL;
+    struct chunk *batch[XFORM_BATCH];
+    struct chunk *c = NULL, *spare = NULL;
+    struct chunk **group = NULL;
+    struct span *in = NULL, *out = NULL;
+    unsigned int ngroup = 0;
+    bool stop = false;
+
+    worker = w;
+    flight_thread("mediator", id);
+    hops_init();
+
+    /* transforms with a group hold its chunks until it is complete */
+    if (group_chunks > 0) {
+        group = malloc(sizeof(struct chunk *) * (group_chunks + 1));
+        in = malloc(sizeof(struct span) * (group_chunks + 1));
+        out = malloc(sizeof(struct span) * (group_chunks + 1));
+        if (!group || !in || !out) {
+            perror("group malloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    while (!stop) {
+        unsigned int n = 0;
+
+        /* wait for a chunk from the reader(s), then take whatever else is
+         * there up to a batch */
+        if (!take_used(&c))
+            break;
+        do {
+            batch[n++] = c;
+
+            /* end of file marker, with several mediators it may overtake
+             * data and we keep going until the writer is finished */
+            if (pipeline_stops(w, &c->item)) {
+                stop = true;
+                break;
+            }
+        } while (n < XFORM_BATCH && get_used(&c));
+        trace_begin(w->wait.trace, TRACE_WORK, n);
+
+        for (unsigned int i = 0; work > 0 && i < n; i++)
+            burn(batch[i], work);
+
+        /* pass chunk ownership to writer, with what the transform flushes
+         * right after each chunk */
+        if (xform && xform->flush) {
+            for (unsigned int i = 0; i < n; i++) {
+                bool eof = batch[i]->item.eof;
+
+                if (!eof)
+                    transform_chunks(state, &batch[i], 1);
+                else
+                    spill(state, &spare, true);
+                put_ready(batch[i]);
+                if (!eof)
+                    spill(state, &spare, false);
+            }
+            trace_end(worker->wait.trace, TRACE_WORK);
+            continue;
+        }
+        if (group_chunks > 0) {
+            for (unsigned int i = 0; i < n; i++) {
+                group[ngroup++] = batch[i];
+                if (!batch[i]->item.eof &&
+                    batch[i]->item.seq % group_chunks != group_chunks - 1)
+                    continue;
+                transform_group(state, group, ngroup, in, out);
+                for (unsigned int k = 0; k < ngroup; k++)
+                    put_ready(group[k]);
+                ngroup = 0;
+            }
+            trace_end(worker->wait.trace, TRACE_WORK);
+            continue;
+        }
+        if (xform)
+            transform_chunks(state, batch, n);
+        for (unsigned int i = 0; i < n; i++)
+            put_ready(batch[i]);
+        trace_end(worker->wait.trace, TRACE_WORK);
+    }
+    free(group);
+    free(in);
+    free(out);
+}
+
+/* adds chunk data that has been written to the integrity check */
+static void
+check_written(struct chunk *c)
+{
+    write_crc = crc32c(write_crc, c->data, c->len);
+    write_bytes += c->len;
+}
+
+/* writes all of buf to fd, exits on error */
+static void
+write_all(int fd, const char *buf, size_t len)
+{
+    while (len > 0) {
+        trace_begin(worker->wait.trace, TRACE_WRITE, (uint32_t)len);
+        ssize_t r = write(fd, buf, len);
+        trace_end(worker->wait.trace, TRACE_WRITE);
+        if (r < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("could not write");
+            exit(EXIT_FAILURE);
+        }
+        buf += r;
+        len -= (size_t)r;
+    }
+}
+
+/* writes batches of ready chunks as linked io_uring writes, so that they hit
+ * stdout in FIFO order.  Returns -1 if io_uring is not available, in which
+ * case no chunk has been consumed. */
+static int
+writer_uring(void)
+{
+    struct uring u;
+    struct io_uring_cqe cqe[URING_DEPTH];
+    struct chunk *batch[URING_DEPTH];
+    struct chunk *w[URING_DEPTH]; /* chunks with data to write */
+    int res[URING_DEPTH];
     struct chunk *c = NULL;
     bool stop = false;
 
+    if (!uring_setup(&u))
+        return -1;
+
     while (!stop) {
-        /* get chunk from reader */
-        while (ringbuf_deq(&used_chunks, (void **)&c) != RINGBUF_OK)
-            pause();
+        unsigned int n = 0;
+        unsigned int nw = 0;
 
-        /* end of file marker */
-        if (c->len == 0)
-            stop = true;
+        /* wait for one ready chunk, then take whatever else is ready */
+        wait_while(&worker->wait, !get_ready(&c));
+        do {
+            batch[n++] = c;
+            if (c->item.eof) {
+                stop = true;
+                break;
+            }
+        } while (n < URING_DEPTH && get_ready(&c));
+
+        /* the end of file marker and chunks that a transform emptied are
+         * not written */
+        for (unsigned int i = 0; i < n; i++)
+            if (batch[i]->len > 0)
+                w[nw++] = batch[i];
+        for (unsigned int i = 0; i < nw; i++)
+            uring_prep_rw(&u, IORING_OP_WRITE_FIXED, STDOUT_FILENO, w[i]->data,
+                          (unsigned int)w[i]->len, -1, w[i]->buf, i,
+                          i + 1 < nw ? IOSQE_IO_LINK : 0);
 
-        /* pass chunk ownership to writer */
-        while (ringbuf_enq(&ready_chunks, c) != RINGBUF_OK)
-            pause();
+        for (unsigned int reaped = 0; reaped < nw;) {
+            trace_begin(worker->wait.trace, TRACE_SUBMIT, nw - reaped);
+            int r = uring_submit(&u, nw - reaped);
+            trace_end(worker->wait.trace, TRACE_SUBMIT);
+            if (r < 0) {
+                errno = -r;
+                perror("could not submit writes");
+                exit(EXIT_FAILURE);
+            }
+            unsigned int k = uring_reap(&u, cqe, URING_DEPTH);
+            for (unsigned int i = 0; i < k; i++)
+                res[cqe[i].user_data] = cqe[i].res;
+            reaped += k;
+        }
+
+        /* a short write cancels the rest of the chain, finish it in order */
+        for (unsigned int i = 0; i < nw; i++) {
+            size_t done = res[i] > 0 ? (size_t)res[i] : 0;
+            if (res[i] < 0 && res[i] != -ECANCELED && res[i] != -EAGAIN &&
+                res[i] != -EINTR) {
+                errno = -res[i];
+                perror("could not write");
+                exit(EXIT_FAILURE);
+            }
+            if (done < w[i]->len)
+                write_all(STDOUT_FILENO, w[i]->data + done, w[i]->len - done);
+            if (check)
+                check_written(w[i]);
+        }
+
+        /* give chunk ownership back to reader */
+        for (unsigned int i = 0; i < n; i++) {
+            time_written(batch[i]);
+            put_free(batch[i]);
+        }
     }
+
+    uring_fini(&u);
     return 0;
 }
 
-/* consumes ready chunks, writes them to stdout, gives them back to reader */
-void *
-writer(void *arg)
+/* consumes ready chunks, writes them to stdout, gives them back to their
+ * pools */
+static void
+writer(struct pipeline_worker *w)
 {
     struct chunk *c = NULL;
     bool stop = false;
 
+    worker = w;
+    flight_thread("writer", 0);
+    hops_init();
+    if (writer_uring() == 0)
+        return;
+
     while (!stop) {
-        /* get chunk ready to be written */
-        while (ringbuf_deq(&ready_chunks, (void **)&c) != RINGBUF_OK)
-            pause();
+        /* get chunk ready to be written, flushing stdout if we must wait */
+        if (!get_ready(&c)) {
+            fflush(stdout);
+            wait_while(&w->wait, !get_ready(&c));
+        }
 
         /* end of file? */
-        if (c->len == 0)
+        if (c->item.eof)
             stop = true;
-        else /* write chunk out */
-            fwrite(c->payload, c->len, 1, stdout);
 
-        /* give chunk ownership back to reader */
-        while (ringbuf_enq(&free_chunks, c) != RINGBUF_OK)
-            pause();
+        /* write chunk out */
+        if (c->len > 0) {
+            trace_begin(worker->wait.trace, TRACE_WRITE, (uint32_t)c->len);
+            fwrite(c->data, c->len, 1, stdout);
+            trace_end(worker->wait.trace, TRACE_WRITE);
+        }
+        if (check)
+            check_written(c);
+        time_written(c);
+
+        /* give chunk ownership back to its pool */
+        put_free(c);
+    }
+}
+
+/* sets up the chunks of the pools of the pipeline and their buffers, each on
+ * the node of the thread that fills it */
+static void
+create_chunks(void)
+{
+    int out_node = pipeline_node(
+        &graph, pipeline_stage_cpu(&graph, STAGE_MEDIATOR, 0));
+    size_t out_size = xform && xform->bound ? xform->bound(chunk_size) : 0;
+
+    nslots = graph.nitems;
+    chunk_iov = malloc(sizeof(struct iovec) * 2 * nslots);
+    if (!chunk_iov) {
+        perror("buffer malloc");
+        exit(EXIT_FAILURE);
+    }
+    arena_init(&payload_arena, nslots, chunk_size, arena_flags);
+    if (out_size > 0)
+        arena_init(&out_arena, nslots, out_size, arena_flags);
+    for (unsigned int i = 0; i < graph.npools; i++) {
+        struct pipeline_pool *pool = &graph.pools[i];
+
+        arena_bind(&payload_arena, pool->first, pool->len,
+                   pipeline_node(&graph, pool->cpu));
+        if (out_size > 0)
+            arena_bind(&out_arena, pool->first, pool->len, out_node);
+    }
+
+    for (unsigned int i = 0; i < nslots; i++) {
+        struct chunk *c = (struct chunk *)pipeline_item_at(&graph, i);
+
+        c->id = i;
+        c->payload = (char *)arena_at(&payload_arena, i);
+        c->buf = i;
+        c->data = c->payload;
+        chunk_iov[i].iov_base = c->payload;
+        chunk_iov[i].iov_len = chunk_size;
+
+        /* out of place transforms write to a buffer of their own */
+        if (out_size > 0) {
+            c->out = (char *)arena_at(&out_arena, i);
+            chunk_iov[nslots + i].iov_base = c->out;
+            chunk_iov[nslots + i].iov_len = out_size;
+        }
+    }
+}
+
+/* opens the input for parallel readers, returns false if it cannot be read
+ * with pread and the single reader should be used instead */
+static bool
+open_ranges(const char *fn)
+{
+    struct stat st;
+
+    /* let the single reader deal with stdin and report open errors */
+    if (strcmp(fn, "-") == 0 || (input_fd = open(fn, O_RDONLY)) < 0)
+        return false;
+    if (fstat(input_fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(input_fd);
+        return false;
+    }
+    input_size = st.st_size;
+    return true;
+}
+
+/* compares what the reader(s) read with what the writer wrote */
+static bool
+check_integrity(void)
+{
+    if (nreaders > 1) {
+        read_crc = 0;
+        read_bytes = (size_t)input_size;
+        for (off_t off = 0; off < input_size; off += block_size) {
+            size_t len = input_size - off > block_size
+                             ? block_size
+                             : (size_t)(input_size - off);
+            read_crc = crc32c_combine(read_crc, block_crc[off / block_size],
+                                      len);
+        }
+    }
+    if (read_crc == write_crc && read_bytes == write_bytes)
+        return true;
+
+    fprintf(stderr,
+            "integrity check failed: read %zu bytes with crc32c %08x, "
+            "wrote %zu bytes with crc32c %08x\n",
+            read_bytes, read_crc, write_bytes, write_crc);
+    flight_dump("integrity check failed");
+    return false;
+}
+
+/* resets the state left by a previous run */
+static void
+reset(void)
+{
+    status = EXIT_SUCCESS;
+    follow = check = tuning = false;
+    timing = false;
+    trace_path = NULL;
+    dump_path = NULL;
+    watchdog = 0;
+    nreaders = nmediators = 1;
+    work = 0;
+    xform = NULL;
+    xform_arg = NULL;
+    read_crc = write_crc = 0;
+    read_bytes = write_bytes = 0;
+    nspare = 0;
+    arena_flags = ARENA_PREFAULT;
+    group_chunks = 0;
+    reader_wait = mediator_wait = writer_wait = WAIT_SPIN;
+    reader_wait_given = mediator_wait_given = writer_wait_given = false;
+    placing = false;
+    place_flags = 0;
+    optind = 1;
+}
+
+/* frees what a run allocated, and forgets its rings and stages */
+static void
+release(void)
+{
+    stats_reset();
+    trace_fini();
+    flight_stop();
+    for (unsigned int i = 0; i < vatomic32_read(&nhop_hists); i++)
+        free(hop_hists[i]);
+    vatomic32_write(&nhop_hists, 0);
+    pipeline_fini(&graph);
+    arena_fini(&payload_arena);
+    arena_fini(&out_arena);
+    if (nreaders > 1)
+        close(input_fd);
+    free(inputs);
+    free(chunk_iov);
+    free(block_crc);
+    free(xform_states);
+    block_crc = NULL;
+    xform_states = NULL;
+}
+
+/* names ring q in the statistics and the flight recorder dumps */
+static void
+name_ring(ringbuf_t *q, const char *fmt, ...)
+{
+    char name[24];
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(name, sizeof(name), fmt, ap);
+    va_end(ap);
+    stats_ring_name(q, "%s", name);
+    flight_ring_name(q, name);
+}
+
+/* names the rings of the pipeline: the free pools of the readers and the
+ * spill pool of the mediator, and the lanes that lead to the mediators
+ * (used) and to the writer (ready), by the threads they go from and to */
+static void
+name_rings(void)
+{
+    name_ring(&opened_files, "opened");
+    for (unsigned int i = 0; i < graph.nworkers; i++) {
+        struct pipeline_worker *w = &graph.workers[i];
+
+        if (w->pool == NULL)
+            continue;
+        if (w->step > 0)
+            name_ring(&w->pool->ring.included, "spill");
+        else if (nreaders > 1)
+            name_ring(&w->pool->ring.included, "free %u", w->instance);
+        else
+            name_ring(&w->pool->ring.included, "free");
+    }
+    for (unsigned int s = 0; s + 1 < graph.nsteps; s++) {
+        struct pipeline_link *l = &graph.links[s];
+        unsigned int rows = pipeline_head(&graph, s)->instances;
+        unsigned int cols = pipeline_head(&graph, s + 1)->instances;
+        const char *to = s + 2 < graph.nsteps ? "used" : "ready";
+
+        for (unsigned int i = 0; !l->ordered && i < rows * cols; i++) {
+            ringbuf_t *q = &l->lanes[i].included;
+
+            if (rows * cols == 1)
+                name_ring(q, "%s", to);
+            else
+                name_ring(q, "%s %u-%u", to, i / cols, i % cols);
+        }
+    }
+}
+
+static void
+usage(const char *prog)
+{
+    printf("usage: %s [-bcfFHILPnRTv] [-j readers] [-m mediators] [-w work] "
+           "[-t transform] [-g pattern] [-W [stage=]policy,...] "
+           "[-X trace.json] [-d seconds] [-D dump] [filename]...\n",
+           prog);
+    printf("transforms:\n");
+    for (size_t i = 0; i < NTRANSFORMS; i++)
+        printf("  %s\n", transforms[i].help);
+    printf("wait policies of the reader, mediator and writer stages:\n");
+    for (size_t i = 0; i < WAIT_POLICIES; i++)
+        printf("  %s\n", wait_names[i]);
+    exit(1);
+}
+
+/* sets the wait policies from a list such as "adaptive" or
+ * "reader=yield,writer=backoff", a policy without a stage applies to all */
+static int
+parse_wait(char *list)
+{
+    for (char *s = strtok(list, ","); s != NULL; s = strtok(NULL, ",")) {
+        char *name = strchr(s, '=');
+        int policy = wait_find(name != NULL ? name + 1 : s);
+
+        if (policy < 0) {
+            fprintf(stderr, "unknown wait policy %s\n", s);
+            return -1;
+        }
+        if (name == NULL) {
+            reader_wait = mediator_wait = writer_wait = policy;
+            reader_wait_given = mediator_wait_given = writer_wait_given = true;
+            continue;
+        }
+        *name = '\0';
+        if (strcmp(s, "reader") == 0) {
+            reader_wait = policy;
+            reader_wait_given = true;
+        } else if (strcmp(s, "mediator") == 0) {
+            mediator_wait = policy;
+            mediator_wait_given = true;
+        } else if (strcmp(s, "writer") == 0) {
+            writer_wait = policy;
+            writer_wait_given = true;
+        } else {
+            fprintf(stderr, "unknown stage %s\n", s);
+            return -1;
+        }
     }
     return 0;
 }
 
+/* Autotuning (-T): the sizes that give the best pass-through throughput over
+ * the first TUNE_BYTES of the input, tried one size at a time, are saved to a
+ * profile for this host, which main() loads at startup.  The profile is
+ * $CCAT_PROFILE, or ~/.ccat.<hostname>. */
+#define TUNE_BYTES (16 * 1024 * 1024)
+#define TUNE_RUNS 3
+
+struct tune_param {
+    const char *name;
+    unsigned int *size;
+    unsigned int values[5];
+};
+
+struct tune_param tune_params[] = {
+    {"chunk_size", &chunk_size, {256, 1024, 4096, 16384, 65536}},
+    {"block_size", &block_size, {4096, 16384, 65536, 262144, 1048576}},
+    {"rbuf_len", &rbuf_len, {8, 16, 32, 64, 256}},
+    {"free_len", &free_len, {32, 64, 128, 256, 1024}},
+};
+#define NTUNE_PARAMS (sizeof(tune_params) / sizeof(tune_params[0]))
+
+int ccat_main(int argc, char *argv[]);
+
+/* returns the path of the profile of this host, or NULL */
+static const char *
+profile_path(void)
+{
+    static char path[4096];
+    const char *home = getenv("HOME");
+    char host[256];
+
+    if (getenv("CCAT_PROFILE") != NULL)
+        return getenv("CCAT_PROFILE");
+    if (home == NULL || gethostname(host, sizeof(host)) != 0)
+        return NULL;
+    host[sizeof(host) - 1] = '\0';
+    snprintf(path, sizeof(path), "%s/.ccat.%s", home, host);
+    return path;
+}
+
+/* returns whether v is a size that -T may pick for p: a power of two in the
+ * range it tries.  Larger chunks would not fit the blocks of lz4, and the
+ * indices of the rings only wrap around correctly for powers of two. */
+static bool
+tune_valid(const struct tune_param *p, unsigned int v)
+{
+    return v >= p->values[0] && v <= p->values[4] && (v & (v - 1)) == 0;
+}
+
+/* loads the sizes saved by -T for this host, if any, or keeps the defaults
+ * if one of them is not a size -T would have saved */
+void
+load_profile(void)
+{
+    const char *path = profile_path();
+    FILE *fp = path != NULL ? fopen(path, "r") : NULL;
+    unsigned int sizes[NTUNE_PARAMS];
+    unsigned int v;
+    char key[32];
+
+    if (fp == NULL)
+        return;
+    for (size_t i = 0; i < NTUNE_PARAMS; i++)
+        sizes[i] = *tune_params[i].size;
+    while (fscanf(fp, "%31s %u", key, &v) == 2)
+        for (size_t i = 0; i < NTUNE_PARAMS; i++)
+            if (strcmp(key, tune_params[i].name) == 0)
+                sizes[i] = v;
+    fclose(fp);
+
+    for (size_t i = 0; i < NTUNE_PARAMS; i++)
+        if (!tune_valid(&tune_params[i], sizes[i])) {
+            fprintf(stderr, "ignoring profile %s: invalid %s %u\n", path,
+                    tune_params[i].name, sizes[i]);
+            return;
+        }
+    /* a block holds whole chunks */
+    if (sizes[1] < sizes[0]) {
+        fprintf(stderr, "ignoring profile %s: block_size %u < chunk_size %u\n",
+                path, sizes[1], sizes[0]);
+        return;
+    }
+    for (size_t i = 0; i < NTUNE_PARAMS; i++)
+        *tune_params[i].size = sizes[i];
+}
+
+/* copies the first TUNE_BYTES of the input to fd */
+static void
+tune_input(const char *input, int fd)
+{
+    int in = strcmp(input, "-") == 0 ? STDIN_FILENO : open(input, O_RDONLY);
+    char buf[PAGE_SIZE];
+    size_t total = 0;
+    ssize_t r;
+
+    if (in < 0) {
+        fprintf(stderr, "could not open %s: %s\n", input, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    while (total < TUNE_BYTES && (r = read(in, buf, sizeof(buf))) != 0) {
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r < 0 || write(fd, buf, (size_t)r) != r) {
+            perror("could not copy tuning input");
+            exit(EXIT_FAILURE);
+        }
+        total += (size_t)r;
+    }
+    if (in != STDIN_FILENO)
+        close(in);
+}
+
+/* returns the best time of running ccat over fn with the current sizes */
+static nanosec_t
+tune_run(char *fn)
+{
+    char *argv[] = {"ccat", fn, 0};
+    nanosec_t best = 0;
+
+    for (int r = 0; r < TUNE_RUNS; r++) {
+        nanosec_t ts = now();
+        if (ccat_main(2, argv) != 0)
+            exit(EXIT_FAILURE);
+        nanosec_t t = now() - ts;
+        if (best == 0 || t < best)
+            best = t;
+    }
+    return best;
+}
+
+/* searches the sizes over the input and saves them to the profile */
+static int
+tune(const char *input)
+{
+    char fn[] = "/tmp/ccat-tune.XXXXXX";
+    const char *path = profile_path();
+    int fd = mkstemp(fn);
+    int out = dup(STDOUT_FILENO);
+    int null = open("/dev/null", O_WRONLY);
+    struct stat st;
+    FILE *fp;
+
+    if (fd < 0 || out < 0 || null < 0 || path == NULL) {
+        perror("could not set up tuning");
+        return 1;
+    }
+    tune_input(input, fd);
+    fstat(fd, &st);
+    close(fd);
+
+    /* the runs write to /dev/null */
+    fflush(stdout);
+    dup2(null, STDOUT_FILENO);
+
+    /* chunks of any size fit in the largest block while they are tried */
+    block_size = tune_params[1].values[4];
+    for (size_t i = 0; i < NTUNE_PARAMS; i++) {
+        struct tune_param *p = &tune_params[i];
+        nanosec_t best = 0;
+        unsigned int best_size = *p->size;
+
+        for (size_t k = 0; k < 5; k++) {
+            if (p->size == &block_size && p->values[k] < chunk_size)
+                continue;
+            *p->size = p->values[k];
+
+            nanosec_t t = tune_run(fn);
+            fprintf(stderr, "%-10s %8u %10.1f MiB/s\n", p->name, *p->size,
+                    (double)st.st_size / (1 << 20) / in_sec(t));
+            if (best == 0 || t < best) {
+                best = t;
+                best_size = *p->size;
+            }
+        }
+        *p->size = best_size;
+    }
+
+    fflush(stdout);
+    dup2(out, STDOUT_FILENO);
+    close(out);
+    close(null);
+    unlink(fn);
+
+    if ((fp = fopen(path, "w")) == NULL) {
+        fprintf(stderr, "could not write %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    for (size_t i = 0; i < NTUNE_PARAMS; i++)
+        fprintf(fp, "%s %u\n", tune_params[i].name, *tune_params[i].size);
+    fclose(fp);
+    fprintf(stderr, "profile saved to %s\n", path);
+    return 0;
+}
+
+/* places the opener next to the reader, the pipeline has placed the other
+ * threads, each next to the one it gets chunks from, and prints the
+ * placement so that a run can be reproduced */
+static void
+place_threads(void)
+{
+    struct placement *pl = &graph.placement;
+    bool shared = false;
+
+    opener_cpu = -1;
+    if (!placing)
+        return;
+
+    fprintf(stderr, "placement%s%s:",
+            pl->flags & PLACE_ISOLATED ? " isolated" : "",
+            pl->flags & PLACE_FIFO ? " fifo" : "");
+    if (nreaders == 1) {
+        opener_cpu = placement_next(pl, graph.workers[0].cpu);
+        fprintf(stderr, " opener %d", opener_cpu);
+        shared = !placement_alone(pl, opener_cpu);
+    }
+    for (unsigned int i = 0; i < graph.nworkers; i++) {
+        struct pipeline_worker *w = &graph.workers[i];
+
+        fprintf(stderr, " %s %d", pipeline_head(&graph, w->step)->name,
+                w->cpu);
+        if (!placement_alone(pl, w->cpu))
+            shared = true;
+    }
+    fprintf(stderr, "\n");
+    if ((pl->flags & PLACE_FIFO) && shared)
+        fprintf(stderr, "more threads than cpus, the threads that share a "
+                        "cpu run without SCHED_FIFO\n");
+}
+
+/* runs ccat with the given arguments and returns its exit status, it can be
+ * called again once it has returned */
 int
-main(int argc, char *argv[])
+ccat_main(int argc, char *argv[])
 {
-    if (argc != 2) {
-        printf("usage: %s <filename>\n", argv[0]);
+    bool unfused = false;
+    int opt;
+
+    reset();
+
+    while ((opt = getopt(argc, argv, "bcd:D:fFg:HIj:Lm:nPRt:TvW:w:X:")) != -1) {
+        switch (opt) {
+        case 'b':
+            xform = transform_find("nonblank", &xform_arg);
+            break;
+        case 'c':
+            check = true;
+            break;
+        case 'd':
+            watchdog = (unsigned int)strtoul(optarg, NULL, 0);
+            break;
+        case 'D':
+            dump_path = optarg;
+            break;
+        case 'f':
+            follow = true;
+            break;
+        case 'F':
+            unfused = true;
+            break;
+        case 'g':
+            xform = transform_find("grep", &xform_arg);
+            xform_arg = optarg;
+            break;
+        case 'H':
+            arena_flags |= ARENA_HUGE | ARENA_LOCK;
+            break;
+        case 'I':
+            placing = true;
+            place_flags |= PLACE_ISOLATED;
+            break;
+        case 'j':
+            nreaders = (unsigned int)atoi(optarg);
+            if (nreaders < 1 || nreaders > MAX_READERS) {
+                fprintf(stderr, "readers must be in [1;%d]\n", MAX_READERS);
+                return 1;
+            }
+            break;
+        case 'L':
+            timing = true;
+            break;
+        case 'm':
+            nmediators = (unsigned int)atoi(optarg);
+            if (nmediators < 1 || nmediators > MAX_MEDIATORS) {
+                fprintf(stderr, "mediators must be in [1;%d]\n",
+                        MAX_MEDIATORS);
+                return 1;
+            }
+            break;
+        case 'n':
+            xform = transform_find("number", &xform_arg);
+            break;
+        case 'P':
+            placing = true;
+            break;
+        case 'R':
+            placing = true;
+            place_flags |= PLACE_FIFO;
+            break;
+        case 't':
+            if ((xform = transform_find(optarg, &xform_arg)) == NULL) {
+                fprintf(stderr, "unknown transform %s\n", optarg);
+                usage(argv[0]);
+            }
+            break;
+        case 'T':
+            tuning = true;
+            break;
+        case 'v':
+            xform = transform_find("escape", &xform_arg);
+            break;
+        case 'W':
+            if (parse_wait(optarg) != 0)
+                usage(argv[0]);
+            break;
+        case 'w':
+            work = strtoul(optarg, NULL, 0);
+            break;
+        case 'X':
+            trace_path = optarg;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (tuning)
+        return tune(argc > optind ? argv[optind] : "-");
+
+    /* a SCHED_FIFO thread that spins keeps its cpu from the rest of the
+     * system, and from the other threads of ccat if they share it */
+    if ((place_flags & PLACE_FIFO) &&
+        ((reader_wait_given && !wait_yields(reader_wait)) ||
+         (mediator_wait_given && !wait_yields(mediator_wait)) ||
+         (writer_wait_given && !wait_yields(writer_wait)))) {
+        fprintf(stderr, "-R needs the yield or adaptive wait policy\n");
         return 1;
     }
 
-    void *buf1 = malloc(sizeof(void *) * FREE_LEN);
-    void *buf2 = malloc(sizeof(void *) * RBUF_LEN);
-    void *buf3 = malloc(sizeof(void *) * RBUF_LEN);
-    if (!buf1 || !buf2 || !buf3) {
-        perror("buffer malloc");
-        exit(EXIT_FAILURE);
+    /* a followed file leaves the pipeline idle between appends, where
+     * spinning would burn a cpu per stage */
+    if (follow || (place_flags & PLACE_FIFO)) {
+        if (!reader_wait_given)
+            reader_wait = WAIT_ADAPTIVE;
+        if (!mediator_wait_given)
+            mediator_wait = WAIT_ADAPTIVE;
+        if (!writer_wait_given)
+            writer_wait = WAIT_ADAPTIVE;
     }
 
-    ringbuf_init(&free_chunks, buf1, FREE_LEN);
-    ringbuf_init(&used_chunks, buf2, RBUF_LEN);
-    ringbuf_init(&ready_chunks, buf3, RBUF_LEN);
+    /* without files, read stdin */
+    ninputs = argc > optind ? (unsigned int)(argc - optind) : 1;
+    if (block_size < chunk_size)
+        block_size = chunk_size;
 
-    for (int i = 0; i < FREE_LEN; i++) {
-        struct chunk *c = (struct chunk *)malloc(sizeof(struct chunk));
-        memset(c, 0, sizeof(struct chunk));
-        if (ringbuf_enq(&free_chunks, c) != RINGBUF_OK) {
-            perror("could not create chunks");
+    /* the output of a transform differs from its input */
+    if (check && xform) {
+        fprintf(stderr, "the integrity check does not support transforms\n");
+        return 1;
+    }
+    if (check)
+        crc32c_init(true);
+
+    /* transforms that keep state across chunks see the stream in order */
+    if (xform && xform->ordered)
+        nreaders = nmediators = 1;
+
+    /* groups are cut from the stream of the single reader.  Each mediator
+     * may hold a group while the reader fills the next one, the pool and
+     * the reorder buffer must have room for all of them. */
+    if (xform && xform->group) {
+        nreaders = 1;
+        group_chunks = (unsigned int)(xform->group / chunk_size);
+        if (group_chunks == 0)
+            group_chunks = 1;
+        if (free_len < (nmediators + 1) * group_chunks)
+            free_len = (nmediators + 1) * group_chunks;
+        while (reorder_len < free_len)
+            reorder_len *= 2;
+    }
+
+    /* parallel readers split a single regular file, which is not followed,
+     * in blocks of whole chunks */
+    if (nreaders > 1 && (follow || argc - optind != 1 ||
+                         block_size % chunk_size != 0 ||
+                         !open_ranges(argv[optind])))
+        nreaders = 1;
+
+    if (check && nreaders > 1) {
+        block_crc = malloc(sizeof(uint32_t) *
+                           (size_t)(input_size / block_size + 1));
+        if (!block_crc) {
+            perror("crc malloc");
             exit(EXIT_FAILURE);
         }
     }
 
-    pthread_t tr, tw, tm;
-    pthread_create(&tr, 0, reader, argv[1]);
-    pthread_create(&tw, 0, writer, 0);
-    pthread_create(&tm, 0, mediator, 0);
-    pthread_join(tr, 0);
-    pthread_join(tw, 0);
-    pthread_join(tm, 0);
+    if (xform) {
+        xform_states = malloc(sizeof(void *) * nmediators);
+        if (!xform_states) {
+            perror("transform malloc");
+            exit(EXIT_FAILURE);
+        }
+        for (unsigned int i = 0; i < nmediators; i++)
+            if ((xform_states[i] = xform->init(xform_arg)) == NULL)
+                return 1;
+    }
+
+    inputs = calloc(ninputs, sizeof(struct input));
+    if (!inputs) {
+        perror("input malloc");
+        exit(EXIT_FAILURE);
+    }
+    for (unsigned int i = 0; i < ninputs; i++)
+        inputs[i].name = argc > optind ? argv[optind + i] : "-";
+
+    if (trace_path != NULL)
+        trace_start();
+    flight_start(dump_path, watchdog);
+
+    /* the pipeline places its threads first, so that the memory goes to
+     * their nodes.  Without a transform or simulated work the mediators only
+     * move pointers, so their stage has no loop and the pipeline fuses it
+     * into the readers, which pass chunks straight to the writer, unless -F
+     * keeps every stage on threads of its own. */
+    stages[STAGE_READER] = (struct stage){
+        .name = "reader",
+        .run = nreaders > 1 ? range_reader : reader,
+        .instances = nreaders,
+        .pool = free_len,
+        .cpu = -1,
+        .wait = reader_wait,
+    };
+    stages[STAGE_MEDIATOR] = (struct stage){
+        .name = "mediator",
+        .run = xform || work > 0 ? mediator : NULL,
+        .instances = nmediators,
+        .pool = xform && xform->flush ? free_len : 0,
+        .group = group_chunks,
+        .cpu = -1,
+        .wait = mediator_wait,
+    };
+    stages[STAGE_WRITER] = (struct stage){
+        .name = "writer",
+        .run = writer,
+        .instances = 1,
+        .cpu = -1,
+        .wait = writer_wait,
+    };
+    graph = (struct pipeline){.stages = stages,
+                              .nstages = NSTAGES,
+                              .item_size = sizeof(struct chunk),
+                              .ring_len = rbuf_len,
+                              .reorder_len = reorder_len,
+                              .pin = placing,
+                              .place_flags = place_flags,
+                              .arena_flags = arena_flags,
+                              .unfused = unfused};
+    if (pipeline_init(&graph) != 0)
+        exit(EXIT_FAILURE);
+    place_threads();
+    create_chunks();
+    ringbuf_init(&opened_files, opened_slots, LOOKAHEAD);
+    name_rings();
+
+    pthread_t to;
+    if (nreaders == 1)
+        pthread_create(&to, 0, opener, 0);
+    pipeline_run(&graph);
+    if (nreaders == 1)
+        pthread_join(to, 0);
+    if (xform && xform->reduce)
+        xform->reduce(xform_states, nmediators);
+    for (unsigned int i = 0; xform && i < nmediators; i++)
+        xform->fini(xform_states[i]);
 
     fflush(stdout);
-    return 0;
+    if (check && !check_integrity())
+        status = EXIT_FAILURE;
+    stats_dump(stderr);
+    if (timing)
+        print_latency();
+    if (trace_path != NULL && trace_write(trace_path, "ccat") != 0)
+        status = EXIT_FAILURE;
+    release();
+    return status;
+}
+
+#ifndef CCAT_NO_MAIN
+int
+main(int argc, char *argv[])
+{
+    load_profile();
+    stats_start();
+    return ccat_main(argc, argv);
 }
+#endif
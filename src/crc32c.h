@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) Huawei Technologies Co., Ltd. 2026. All rights reserved.
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef CRC32C_H
+#define CRC32C_H
+/*******************************************************************************
+ * CRC32C (Castagnoli), as used by iSCSI, ext4 and btrfs.
+ *
+ * crc32c() uses the SSE4.2 crc32 instruction on x86 and the ARMv8 CRC
+ * instructions on Arm when the running cpu has them, and slicing-by-8 tables
+ * otherwise.  Call crc32c_init() once before the first crc32c(), asking for
+ * the tables only if the instructions should not be used.  As with
+ * zlib's crc32(), the crc of a stream is computed by passing the crc of what
+ * came before, starting with 0, and crc32c_combine() gives the crc of the
+ * concatenation of two buffers from their crcs.
+ ******************************************************************************/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+#define CRC32C_SSE42
+#elif defined(__aarch64__) && defined(__linux__) && defined(__GNUC__)
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#define CRC32C_ARM
+#ifndef HWCAP_CRC32
+#define HWCAP_CRC32 (1 << 7)
+#endif
+#endif
+
+#define CRC32C_POLY 0x82f63b78 /* reflected 0x1edc6f41 */
+
+static uint32_t crc32c_table[8][256];
+static uint32_t crc32c_x2n[67]; /* x^(2^k) mod p */
+
+/* slicing-by-8: 8 table lookups per 8 bytes, little endian only */
+static inline uint32_t
+crc32c_sw(uint32_t crc, const unsigned char *p, size_t len)
+{
+    for (; len > 0 && ((uintptr_t)p & 7) != 0; len--)
+        crc = crc32c_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+
+    for (; len >= 8; len -= 8, p += 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        w ^= crc;
+        crc = crc32c_table[7][w & 0xff] ^ crc32c_table[6][(w >> 8) & 0xff] ^
+              crc32c_table[5][(w >> 16) & 0xff] ^
+              crc32c_table[4][(w >> 24) & 0xff] ^
+              crc32c_table[3][(w >> 32) & 0xff] ^
+              crc32c_table[2][(w >> 40) & 0xff] ^
+              crc32c_table[1][(w >> 48) & 0xff] ^ crc32c_table[0][w >> 56];
+    }
+
+    for (; len > 0; len--)
+        crc = crc32c_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    return crc;
+}
+
+#ifdef CRC32C_SSE42
+__attribute__((target("sse4.2"))) static inline uint32_t
+crc32c_hw(uint32_t crc, const unsigned char *p, size_t len)
+{
+    for (; len > 0 && ((uintptr_t)p & 7) != 0; len--)
+        crc = _mm_crc32_u8(crc, *p++);
+#ifdef __x86_64__
+    for (; len >= 8; len -= 8, p += 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        crc = (uint32_t)_mm_crc32_u64(crc, w);
+    }
+#endif
+    for (; len > 0; len--)
+        crc = _mm_crc32_u8(crc, *p++);
+    return crc;
+}
+
+static inline bool
+crc32c_hw_supported(void)
+{
+    return __builtin_cpu_supports("sse4.2");
+}
+#endif
+
+#ifdef CRC32C_ARM
+__attribute__((target("+crc"))) static inline uint32_t
+crc32c_hw(uint32_t crc, const unsigned char *p, size_t len)
+{
+    for (; len > 0 && ((uintptr_t)p & 7) != 0; len--)
+        crc = __crc32cb(crc, *p++);
+    for (; len >= 8; len -= 8, p += 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        crc = __crc32cd(crc, w);
+    }
+    for (; len > 0; len--)
+        crc = __crc32cb(crc, *p++);
+    return crc;
+}
+
+static inline bool
+crc32c_hw_supported(void)
+{
+    return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+}
+#endif
+
+static uint32_t (*crc32c_update)(uint32_t, const unsigned char *,
+                                 size_t) = crc32c_sw;
+
+/* returns a * b mod p, a must not be 0 */
+static inline uint32_t
+crc32c_multmodp(uint32_t a, uint32_t b)
+{
+    uint32_t m = 1U << 31, p = 0;
+
+    for (;;) {
+        if (a & m) {
+            p ^= b;
+            if ((a & (m - 1)) == 0)
+                break;
+        }
+        m >>= 1;
+        b = b & 1 ? (b >> 1) ^ CRC32C_POLY : b >> 1;
+    }
+    return p;
+}
+
+/* returns x^(8n) mod p */
+static inline uint32_t
+crc32c_x8n(size_t n)
+{
+    uint32_t p = 1U << 31; /* x^0 */
+
+    for (unsigned int k = 3; n != 0; n >>= 1, k++)
+        if (n & 1)
+            p = crc32c_multmodp(crc32c_x2n[k], p);
+    return p;
+}
+
+/* selects the implementation and fills the tables */
+static inline void
+crc32c_init(bool hw)
+{
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++)
+            c = c & 1 ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+        crc32c_table[0][i] = c;
+    }
+    for (int t = 1; t < 8; t++)
+        for (int i = 0; i < 256; i++) {
+            uint32_t c = crc32c_table[t - 1][i];
+            crc32c_table[t][i] = crc32c_table[0][c & 0xff] ^ (c >> 8);
+        }
+
+    crc32c_x2n[0] = 1U << 30; /* x^1 */
+    for (int k = 1; k < 67; k++)
+        crc32c_x2n[k] = crc32c_multmodp(crc32c_x2n[k - 1], crc32c_x2n[k - 1]);
+
+    crc32c_update = crc32c_sw;
+#if defined(CRC32C_SSE42) || defined(CRC32C_ARM)
+    if (hw && crc32c_hw_supported())
+        crc32c_update = crc32c_hw;
+#endif
+}
+
+/* returns true if crc32c() uses the crc instructions of the cpu */
+static inline bool
+crc32c_accelerated(void)
+{
+    return crc32c_update != crc32c_sw;
+}
+
+static inline uint32_t
+crc32c(uint32_t crc, const void *buf, size_t len)
+{
+    return ~crc32c_update(~crc, (const unsigned char *)buf, len);
+}
+
+/* returns the crc of A followed by B, given crc1 of A, crc2 of B and the
+ * length of B */
+static inline uint32_t
+crc32c_combine(uint32_t crc1, uint32_t crc2, size_t len2)
+{
+    return crc32c_multmodp(crc32c_x8n(len2), crc1) ^ crc2;
+}
+
+#endif
@@ -0,0 +1,417 @@
+/*
+ * Copyright (C) Huawei Technologies Co., Ltd. 2026. All rights reserved.
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef FLIGHT_H
+#define FLIGHT_H
+/*******************************************************************************
+ * Flight recorder: the last ring operations of every thread, kept all the time
+ * and dumped when something goes wrong.
+ *
+ * Each thread that calls flight_thread() logs its enqueues and dequeues into a
+ * circular log of its own, FLIGHT_EVENTS events long: the ring, its head and
+ * tail as seen after the operation, the pointer that went through and its
+ * length, or the result of a failed operation.  Failed operations that find
+ * the ring in the same state are folded into one event with a repeat count,
+ * so a thread that polls an empty ring forever does not wipe its history.
+ * The header redefines ringbuf_enq() and ringbuf_deq() to log, on top of the
+ * counting of stats.h, so it must come after the ring variant.  The includer
+ * may define FLIGHT_LEN(q, v) to give the length of the pointer v that went
+ * through ring q, 0 otherwise.
+ *
+ * A log has a single writer and no atomics: the writer stores the event and
+ * then bumps its count.  Only the failed operations, which are about to wait
+ * anyway, read the clock, so a successful one costs a few stores.
+ * flight_dump() reads the logs without stopping their threads, so the newest
+ * event of a thread that is still running may be torn.  It formats its lines
+ * by hand and only calls open(), write() and close(), which are safe in a
+ * signal handler:
+ * flight_start() installs one for SIGABRT and SIGQUIT, and can start a
+ * watchdog thread that dumps the logs when they stop growing.
+ ******************************************************************************/
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <vsync/atomic.h>
+
+#include "now.h"
+#include "ringbuf.h"
+#include "stats.h"
+
+#define FLIGHT_THREADS 256
+#define FLIGHT_EVENTS 256 /* per thread, a power of two */
+#define FLIGHT_RINGS 256  /* rings with a name in the dump */
+
+#ifndef FLIGHT_LEN
+#define FLIGHT_LEN(q, v) 0
+#endif
+
+/* reads the head or the tail of a ring, plain or atomic as the variant has */
+#define flight_index(x)                                                        \
+    _Generic((x),                                                              \
+        vatomic32_t: vatomic32_read_rlx((vatomic32_t *)&(x)),                  \
+        default: *(volatile unsigned int *)&(x))
+
+enum flight_op {
+    FLIGHT_ENQ,
+    FLIGHT_DEQ,
+};
+
+struct flight_event {
+    nanosec_t ts; /* of the first failure, 0 if the operation succeeded */
+    const void *ring;
+    const void *ptr; /* NULL if the operation failed */
+    uint32_t head, tail;
+    uint32_t len;
+    uint32_t repeat; /* operations folded into the event */
+    uint8_t op;      /* enum flight_op */
+    uint8_t result;  /* RINGBUF_OK, RINGBUF_FULL or RINGBUF_EMPTY */
+};
+
+struct flight_log {
+    char name[24];
+    uint64_t n; /* events logged, the last FLIGHT_EVENTS are kept */
+    struct flight_event ev[FLIGHT_EVENTS];
+} __attribute__((aligned(64)));
+
+struct flight_ring {
+    const void *ring;
+    char name[24];
+};
+
+static struct flight_log flight_logs[FLIGHT_THREADS];
+static vatomic32_t flight_nlogs;
+static __thread struct flight_log *flight_self;
+static struct flight_ring flight_rings[FLIGHT_RINGS];
+static unsigned int flight_nrings;
+static const char *flight_path; /* NULL for stderr */
+
+/* the watchdog, see flight_start() */
+static unsigned int flight_timeout;
+static vatomic32_t flight_watching;
+static pthread_t flight_watchdog_thread;
+
+/* starts logging the ring operations of the calling thread, named name and
+ * id */
+static inline void
+flight_thread(const char *name, unsigned int id)
+{
+    unsigned int k = vatomic32_get_inc(&flight_nlogs);
+    struct flight_log *l;
+
+    if (k >= FLIGHT_THREADS)
+        return;
+    l = &flight_logs[k];
+    snprintf(l->name, sizeof(l->name), "%s %u", name, id);
+    l->n = 0;
+    flight_self = l;
+}
+
+/* names ring q in the dump */
+static inline void
+flight_ring_name(const void *q, const char *name)
+{
+    if (flight_nrings == FLIGHT_RINGS)
+        return;
+    flight_rings[flight_nrings].ring = q;
+    snprintf(flight_rings[flight_nrings].name,
+             sizeof(flight_rings[flight_nrings].name), "%s", name);
+    flight_nrings++;
+}
+
+/* logs an operation of the calling thread on ring q with result r, and if it
+ * succeeded, the pointer that went through and its length */
+static inline void
+flight_record(enum flight_op op, ringbuf_t *q, int r, const void *ptr,
+              size_t len)
+{
+    struct flight_log *l = flight_self;
+    uint32_t head = flight_index(q->head);
+    uint32_t tail = flight_index(q->tail);
+    struct flight_event *e;
+
+    if (r != RINGBUF_OK && l->n > 0) {
+        e = &l->ev[(l->n - 1) % FLIGHT_EVENTS];
+        if (e->ring == q && e->op == op && e->result == r &&
+            e->head == head && e->tail == tail) {
+            e->repeat++;
+            return;
+        }
+    }
+    e = &l->ev[l->n % FLIGHT_EVENTS];
+    e->ts = r == RINGBUF_OK ? 0 : now();
+    e->ring = q;
+    e->ptr = r == RINGBUF_OK ? ptr : NULL;
+    e->head = head;
+    e->tail = tail;
+    e->len = r == RINGBUF_OK ? (uint32_t)len : 0;
+    e->repeat = 1;
+    e->op = (uint8_t)op;
+    e->result = (uint8_t)r;
+    l->n++;
+}
+
+/* the operations as macros, so that even an -O0 build only adds a branch for
+ * the threads that do not log.  They evaluate their arguments once, and an
+ * enqueue takes the length before the ring hands the pointer to the consumer,
+ * which may change or free what it points to as soon as it is in. */
+#undef ringbuf_enq
+#undef ringbuf_deq
+#define ringbuf_enq(q, v)                                                      \
+    ({                                                                         \
+        ringbuf_t *flight_q = (q);                                             \
+        void *flight_v = (v);                                                  \
+        size_t flight_len =                                                    \
+            flight_self != NULL ? FLIGHT_LEN(flight_q, flight_v) : 0;          \
+        int flight_r = stats_op((ringbuf_enq)(flight_q, flight_v), flight_q);  \
+        if (flight_self != NULL)                                               \
+            flight_record(FLIGHT_ENQ, flight_q, flight_r, flight_v,            \
+                          flight_len);                                         \
+        flight_r;                                                              \
+    })
+#define ringbuf_deq(q, v)                                                      \
+    ({                                                                         \
+        ringbuf_t *flight_q = (q);                                             \
+        void **flight_v = (void **)(v);                                        \
+        int flight_r = stats_op((ringbuf_deq)(flight_q, flight_v), flight_q);  \
+        if (flight_self != NULL && flight_r == RINGBUF_OK)                     \
+            flight_record(FLIGHT_DEQ, flight_q, flight_r, *flight_v,           \
+                          FLIGHT_LEN(flight_q, *flight_v));                    \
+        else if (flight_self != NULL)                                          \
+            flight_record(FLIGHT_DEQ, flight_q, flight_r, NULL, 0);            \
+        flight_r;                                                              \
+    })
+
+/* A line of the dump, formatted by hand: the dump runs in a signal handler,
+ * where the stdio functions are not safe to call. */
+struct flight_line {
+    char buf[160];
+    size_t n;
+};
+
+static inline void
+flight_puts(struct flight_line *b, const char *s)
+{
+    while (*s != '\0' && b->n < sizeof(b->buf))
+        b->buf[b->n++] = *s++;
+}
+
+/* appends spaces up to column col */
+static inline void
+flight_pad(struct flight_line *b, size_t col)
+{
+    while (b->n < col && b->n < sizeof(b->buf))
+        b->buf[b->n++] = ' ';
+}
+
+/* appends v in base 10 or 16, right aligned to width */
+static inline void
+flight_putu(struct flight_line *b, uint64_t v, unsigned int base, size_t width)
+{
+    char digits[24];
+    size_t k = sizeof(digits);
+
+    digits[--k] = '\0';
+    do {
+        digits[--k] = "0123456789abcdef"[v % base];
+        v /= base;
+    } while (v != 0);
+    while (sizeof(digits) - 1 - k < width && k > 0)
+        digits[--k] = ' ';
+    flight_puts(b, &digits[k]);
+}
+
+static inline void
+flight_putp(struct flight_line *b, const void *p)
+{
+    flight_puts(b, "0x");
+    flight_putu(b, (uintptr_t)p, 16, 0);
+}
+
+/* writes the line to fd and empties it */
+static inline void
+flight_flush(int fd, struct flight_line *b)
+{
+    if (b->n > 0 && write(fd, b->buf, b->n) < 0)
+        b->n = 0;
+    b->n = 0;
+}
+
+static inline const char *
+flight_ring_of(const void *q)
+{
+    for (unsigned int i = 0; i < flight_nrings; i++)
+        if (flight_rings[i].ring == q)
+            return flight_rings[i].name;
+    return NULL;
+}
+
+static inline void
+flight_dump_log(int fd, const struct flight_log *l, nanosec_t t)
+{
+    static const char *results[] = {"ok", "empty", "full", "again"};
+    uint64_t n = l->n;
+    uint64_t first = n > FLIGHT_EVENTS ? n - FLIGHT_EVENTS : 0;
+    struct flight_line b = {.n = 0};
+
+    flight_puts(&b, l->name);
+    flight_puts(&b, ": ");
+    flight_putu(&b, n, 10, 0);
+    flight_puts(&b, " events, the last ");
+    flight_putu(&b, n - first, 10, 0);
+    flight_puts(&b, ":\n");
+    flight_flush(fd, &b);
+    for (uint64_t k = first; k < n; k++) {
+        const struct flight_event *e = &l->ev[k % FLIGHT_EVENTS];
+        const char *name = flight_ring_of(e->ring);
+        nanosec_t ago = t > e->ts ? (t - e->ts) / NOW_MICROSECOND : 0;
+        size_t start;
+
+        flight_puts(&b, e->op == FLIGHT_ENQ ? "  enq " : "  deq ");
+        start = b.n;
+        if (name != NULL)
+            flight_puts(&b, name);
+        else
+            flight_putp(&b, e->ring);
+        flight_pad(&b, start + 14);
+        flight_puts(&b, " head ");
+        flight_putu(&b, e->head, 10, 10);
+        flight_puts(&b, " tail ");
+        flight_putu(&b, e->tail, 10, 10);
+        flight_puts(&b, "  ");
+        if (e->result == RINGBUF_OK) {
+            flight_putp(&b, e->ptr);
+            flight_puts(&b, " len ");
+            flight_putu(&b, e->len, 10, 0);
+        } else {
+            flight_puts(&b, e->result < 4 ? results[e->result] : "?");
+            flight_puts(&b, " x");
+            flight_putu(&b, e->repeat, 10, 0);
+            flight_puts(&b, ", first ");
+            flight_putu(&b, ago, 10, 0);
+            flight_puts(&b, " us ago");
+        }
+        flight_puts(&b, "\n");
+        flight_flush(fd, &b);
+    }
+}
+
+/* writes the logs of all threads, oldest event first, to the file given to
+ * flight_start() or to stderr, saying why */
+static inline void
+flight_dump(const char *why)
+{
+    unsigned int n = vatomic32_read(&flight_nlogs);
+    nanosec_t t = now();
+    int fd = STDERR_FILENO;
+    struct flight_line b = {.n = 0};
+
+    if (flight_path != NULL &&
+        (fd = open(flight_path, O_WRONLY | O_CREAT | O_APPEND, 0644)) < 0)
+        fd = STDERR_FILENO;
+    if (n > FLIGHT_THREADS)
+        n = FLIGHT_THREADS;
+    flight_puts(&b, "flight recorder: ");
+    flight_puts(&b, why);
+    flight_puts(&b, ", ");
+    flight_putu(&b, n, 10, 0);
+    flight_puts(&b, " threads\n");
+    flight_flush(fd, &b);
+    for (unsigned int i = 0; i < n; i++)
+        flight_dump_log(fd, &flight_logs[i], t);
+    if (fd != STDERR_FILENO)
+        close(fd);
+}
+
+static inline void
+flight_signal(int sig)
+{
+    flight_dump(sig == SIGABRT ? "SIGABRT" : "SIGQUIT");
+    raise(sig); /* the default action, the handler was reset */
+}
+
+/* sums the events of all threads, which grows as long as some thread gets
+ * through a ring or finds it in a new state */
+static inline uint64_t
+flight_progress(void)
+{
+    unsigned int n = vatomic32_read(&flight_nlogs);
+    uint64_t sum = 0;
+
+    for (unsigned int i = 0; i < n && i < FLIGHT_THREADS; i++)
+        sum += *(volatile uint64_t *)&flight_logs[i].n;
+    return sum;
+}
+
+static inline void *
+flight_watchdog(void *arg)
+{
+    struct timespec tick = {0, 100 * 1000 * 1000};
+    uint64_t last = flight_progress();
+    nanosec_t since = now();
+    bool dumped = false;
+
+    while (vatomic32_read(&flight_watching)) {
+        uint64_t p;
+
+        nanosleep(&tick, NULL);
+        p = flight_progress();
+        if (p != last) {
+            last = p;
+            since = now();
+            dumped = false;
+        } else if (!dumped && now() - since >= flight_timeout * NOW_SECOND) {
+            char why[48];
+
+            snprintf(why, sizeof(why), "no progress for %u s",
+                     flight_timeout);
+            flight_dump(why);
+            dumped = true;
+        }
+    }
+    return 0;
+}
+
+/* forgets the logs of a previous run, dumps them to path, or stderr if path
+ * is NULL, on SIGABRT and SIGQUIT, and if timeout is not 0, whenever they
+ * stop growing for timeout seconds */
+static inline void
+flight_start(const char *path, unsigned int timeout)
+{
+    struct sigaction sa;
+
+    vatomic32_write(&flight_nlogs, 0);
+    flight_nrings = 0;
+    flight_path = path;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = flight_signal;
+    sa.sa_flags = SA_RESETHAND;
+    sigaction(SIGABRT, &sa, NULL);
+    sigaction(SIGQUIT, &sa, NULL);
+
+    flight_timeout = timeout;
+    if (timeout == 0)
+        return;
+    vatomic32_write(&flight_watching, 1);
+    if (pthread_create(&flight_watchdog_thread, 0, flight_watchdog, NULL))
+        vatomic32_write(&flight_watching, 0);
+}
+
+/* stops the watchdog, the logs stay until the next flight_start() */
+static inline void
+flight_stop(void)
+{
+    if (!vatomic32_read(&flight_watching))
+        return;
+    vatomic32_write(&flight_watching, 0);
+    pthread_join(flight_watchdog_thread, NULL);
+}
+
+#endif
@@ -0,0 +1,899 @@
+/*
+ * Copyright (C) Huawei Technologies Co., Ltd. 2026. All rights reserved.
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef KERNELS_H
+#define KERNELS_H
+/*******************************************************************************
+ * Byte kernels used by the mediator transforms.
+ *
+ * Every kernel has a scalar version and, depending on the target, SSE2 and
+ * AVX2 (x86) or NEON (aarch64) versions.  AVX2 is selected at runtime, so the
+ * program does not need to be compiled with -mavx2.  The vector versions
+ * must produce exactly the same output as the scalar ones.
+ *
+ * - map:    in-place byte map (tr).  Maps made of a few shifted ranges, such
+ *           as a-z -> A-Z, are vectorized; other maps use a lookup table.
+ * - fold:   in-place case folding of ASCII letters.
+ * - escape: `cat -v` notation of control and non-ASCII bytes.  Vectors
+ *           without such bytes are copied as is.
+ * - eol:    bit mask of the newlines in a block of EOL_BLOCK bytes, bit i
+ *           is set if p[i] is a newline (cmpeq + movemask).
+ * - words:  bit masks of the white space bytes and of the other printable
+ *           bytes in a block of EOL_BLOCK bytes, from which wc tells where
+ *           words start.
+ * - hex:    lower case hexadecimal of each byte, from a nibble lookup table
+ *           (pshufb, tbl) or from compares on SSE2.
+ * - base64: base64 of a multiple of 3 bytes.  The vector versions spread
+ *           each 3 bytes over 4 with a shuffle, move the 6-bit fields in
+ *           place with multiplies and turn them into characters with a
+ *           lookup of the offset of their range (AVX2), or deinterleave the
+ *           bytes and look the characters up in a 64-byte table (NEON).  SSE2
+ *           has no byte shuffle and uses the scalar version.
+ * - find:   first occurrence of a substring.  The vector versions compare a
+ *           vector of candidate positions with the first and with the last
+ *           byte of the substring, and only check the candidates that match
+ *           both ("generic SIMD strstr").  SSE2 and AVX2 take 64 candidates
+ *           at a time and test them all at once, since most blocks have
+ *           none.
+ ******************************************************************************/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#if defined(__SSE2__)
+#define KERNELS_SSE2
+#endif
+#if defined(__GNUC__)
+#define KERNELS_AVX2
+#endif
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define KERNELS_NEON
+#endif
+
+#define MAP_RANGES 8
+#define EOL_BLOCK 64
+
+/* a byte map, with its decomposition in ranges [lo, lo + len] that are
+ * shifted by delta.  nranges is 0 if the map needs more than MAP_RANGES. */
+struct byte_map {
+    unsigned char table[256];
+    unsigned int nranges;
+    unsigned char lo[MAP_RANGES];
+    unsigned char len[MAP_RANGES];
+    unsigned char delta[MAP_RANGES];
+};
+
+static inline void
+byte_map_init(struct byte_map *m)
+{
+    for (int i = 0; i < 256; i++)
+        m->table[i] = (unsigned char)i;
+    m->nranges = 0;
+}
+
+/* computes the range decomposition of m->table */
+static inline void
+byte_map_ranges(struct byte_map *m)
+{
+    unsigned int n = 0;
+
+    for (int i = 0; i < 256;) {
+        unsigned char d = (unsigned char)(m->table[i] - i);
+        int j = i + 1;
+
+        while (j < 256 && (unsigned char)(m->table[j] - j) == d)
+            j++;
+        if (d != 0) {
+            if (n == MAP_RANGES) {
+                m->nranges = 0;
+                return;
+            }
+            m->lo[n] = (unsigned char)i;
+            m->len[n] = (unsigned char)(j - 1 - i);
+            m->delta[n] = d;
+            n++;
+        }
+        i = j;
+    }
+    m->nranges = n;
+}
+
+/* writes the `cat -v` notation of c to out, returns its length (1 to 4) */
+static inline size_t
+escape_byte(unsigned char c, char *out)
+{
+    size_t n = 0;
+
+    if (c >= 128) {
+        out[n++] = 'M';
+        out[n++] = '-';
+        c -= 128;
+        if (c < 32) {
+            out[n++] = '^';
+            out[n++] = (char)(c + 64);
+            return n;
+        }
+    } else if (c < 32 && c != '\t' && c != '\n') {
+        out[n++] = '^';
+        out[n++] = (char)(c + 64);
+        return n;
+    }
+    if (c == 127) {
+        out[n++] = '^';
+        out[n++] = '?';
+    } else {
+        out[n++] = (char)c;
+    }
+    return n;
+}
+
+/* scalar kernels */
+
+static inline void
+map_scalar(const struct byte_map *m, char *buf, size_t n)
+{
+    unsigned char *p = (unsigned char *)buf;
+    for (size_t i = 0; i < n; i++)
+        p[i] = m->table[p[i]];
+}
+
+static inline void
+fold_scalar(char *buf, size_t n, bool upper)
+{
+    unsigned char lo = upper ? 'a' : 'A';
+    unsigned char delta = upper ? (unsigned char)-32 : 32;
+    unsigned char *p = (unsigned char *)buf;
+
+    for (size_t i = 0; i < n; i++)
+        p[i] += (unsigned char)(p[i] - lo) <= 25 ? delta : 0;
+}
+
+static inline size_t
+escape_scalar(const char *in, size_t n, char *out)
+{
+    size_t o = 0;
+    for (size_t i = 0; i < n; i++)
+        o += escape_byte((unsigned char)in[i], out + o);
+    return o;
+}
+
+static inline uint64_t
+eol_scalar(const char *p)
+{
+    uint64_t m = 0;
+    for (int i = 0; i < EOL_BLOCK; i++)
+        m |= (uint64_t)(p[i] == '\n') << i;
+    return m;
+}
+
+/* white space as isspace() in the C locale */
+static inline bool
+is_space(unsigned char c)
+{
+    return c == ' ' || (unsigned char)(c - '\t') <= '\r' - '\t';
+}
+
+static inline void
+words_scalar(const char *p, uint64_t *space, uint64_t *graph)
+{
+    uint64_t s = 0, g = 0;
+    for (int i = 0; i < EOL_BLOCK; i++) {
+        unsigned char c = (unsigned char)p[i];
+        s |= (uint64_t)is_space(c) << i;
+        g |= (uint64_t)((unsigned char)(c - '!') <= '~' - '!') << i;
+    }
+    *space = s;
+    *graph = g;
+}
+
+static const char hex_digits[16] = "0123456789abcdef";
+static const char base64_digits[64] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static inline void
+hex_scalar(const char *in, size_t n, char *out)
+{
+    for (size_t i = 0; i < n; i++) {
+        unsigned char c = (unsigned char)in[i];
+        out[2 * i] = hex_digits[c >> 4];
+        out[2 * i + 1] = hex_digits[c & 15];
+    }
+}
+
+static inline void
+base64_scalar(const char *in, size_t n, char *out)
+{
+    const unsigned char *p = (const unsigned char *)in;
+
+    for (size_t i = 0; i + 3 <= n; i += 3, out += 4) {
+        uint32_t v = (uint32_t)p[i] << 16 | (uint32_t)p[i + 1] << 8 | p[i + 2];
+        out[0] = base64_digits[v >> 18];
+        out[1] = base64_digits[v >> 12 & 63];
+        out[2] = base64_digits[v >> 6 & 63];
+        out[3] = base64_digits[v & 63];
+    }
+}
+
+/* returns true if the m bytes of p are at h, knowing that the first and the
+ * last bytes match */
+static inline bool
+find_check(const char *h, const char *p, size_t m)
+{
+    return m <= 2 || memcmp(h + 1, p + 1, m - 2) == 0;
+}
+
+/* returns the offset of p in h, or n if h does not contain p, m > 0 */
+static inline size_t
+find_scalar(const char *h, size_t n, const char *p, size_t m)
+{
+    const char *end = h + n - m + 1;
+
+    if (n < m)
+        return n;
+    for (const char *c = h; c < end; c++) {
+        c = memchr(c, p[0], (size_t)(end - c));
+        if (c == NULL)
+            break;
+        if (c[m - 1] == p[m - 1] && find_check(c, p, m))
+            return (size_t)(c - h);
+    }
+    return n;
+}
+
+/* SSE2 kernels */
+
+#ifdef KERNELS_SSE2
+/* mask of the bytes of x in [lo, lo + len] */
+static inline __m128i
+range_sse2(__m128i x, unsigned char lo, unsigned char len)
+{
+    __m128i t = _mm_sub_epi8(x, _mm_set1_epi8((char)lo));
+    return _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8((char)len)), t);
+}
+
+static inline void
+map_sse2(const struct byte_map *m, char *buf, size_t n)
+{
+    size_t i = 0;
+
+    if (m->nranges == 0) {
+        map_scalar(m, buf, n);
+        return;
+    }
+    for (; i + 16 <= n; i += 16) {
+        __m128i x = _mm_loadu_si128((__m128i *)(buf + i));
+        __m128i r = x;
+        for (unsigned int k = 0; k < m->nranges; k++) {
+            __m128i d = _mm_set1_epi8((char)m->delta[k]);
+            __m128i in = range_sse2(x, m->lo[k], m->len[k]);
+            r = _mm_add_epi8(r, _mm_and_si128(in, d));
+        }
+        _mm_storeu_si128((__m128i *)(buf + i), r);
+    }
+    map_scalar(m, buf + i, n - i);
+}
+
+static inline void
+fold_sse2(char *buf, size_t n, bool upper)
+{
+    unsigned char lo = upper ? 'a' : 'A';
+    __m128i d = _mm_set1_epi8(upper ? -32 : 32);
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i x = _mm_loadu_si128((__m128i *)(buf + i));
+        __m128i in = range_sse2(x, lo, 25);
+        x = _mm_add_epi8(x, _mm_and_si128(in, d));
+        _mm_storeu_si128((__m128i *)(buf + i), x);
+    }
+    fold_scalar(buf + i, n - i, upper);
+}
+
+/* mask of the bytes that cat -v escapes: below 32 except tab and newline,
+ * and 127 and above */
+static inline __m128i
+special_sse2(__m128i x)
+{
+    __m128i ctl = _mm_cmplt_epi8(x, _mm_set1_epi8(32)); /* also >= 128 */
+    __m128i del = _mm_cmpeq_epi8(x, _mm_set1_epi8(127));
+    __m128i tab = _mm_cmpeq_epi8(x, _mm_set1_epi8('\t'));
+    __m128i nl = _mm_cmpeq_epi8(x, _mm_set1_epi8('\n'));
+    return _mm_andnot_si128(_mm_or_si128(tab, nl), _mm_or_si128(ctl, del));
+}
+
+static inline size_t
+escape_sse2(const char *in, size_t n, char *out)
+{
+    size_t i = 0, o = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(in + i));
+        if (_mm_movemask_epi8(special_sse2(x)) == 0) {
+            _mm_storeu_si128((__m128i *)(out + o), x);
+            o += 16;
+        } else {
+            o += escape_scalar(in + i, 16, out + o);
+        }
+    }
+    return o + escape_scalar(in + i, n - i, out + o);
+}
+
+static inline uint64_t
+eol_sse2(const char *p)
+{
+    __m128i nl = _mm_set1_epi8('\n');
+    uint64_t m = 0;
+
+    for (int i = 0; i < EOL_BLOCK; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(p + i));
+        m |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(x, nl)) << i;
+    }
+    return m;
+}
+
+static inline void
+words_sse2(const char *p, uint64_t *space, uint64_t *graph)
+{
+    __m128i sp = _mm_set1_epi8(' ');
+    uint64_t s = 0, g = 0;
+
+    for (int i = 0; i < EOL_BLOCK; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(p + i));
+        __m128i ws = _mm_or_si128(_mm_cmpeq_epi8(x, sp),
+                                  range_sse2(x, '\t', '\r' - '\t'));
+        __m128i gr = range_sse2(x, '!', '~' - '!');
+        s |= (uint64_t)(uint16_t)_mm_movemask_epi8(ws) << i;
+        g |= (uint64_t)(uint16_t)_mm_movemask_epi8(gr) << i;
+    }
+    *space = s;
+    *graph = g;
+}
+
+/* nibble n is '0' + n, plus 39 to get to 'a' above 9 */
+static inline __m128i
+hex_digits_sse2(__m128i n)
+{
+    __m128i c = _mm_add_epi8(n, _mm_set1_epi8('0'));
+    __m128i letter = _mm_cmpgt_epi8(n, _mm_set1_epi8(9));
+    return _mm_add_epi8(c, _mm_and_si128(letter, _mm_set1_epi8(39)));
+}
+
+static inline void
+hex_sse2(const char *in, size_t n, char *out)
+{
+    __m128i low = _mm_set1_epi8(15);
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(in + i));
+        __m128i hi = hex_digits_sse2(_mm_and_si128(_mm_srli_epi16(x, 4), low));
+        __m128i lo = hex_digits_sse2(_mm_and_si128(x, low));
+        _mm_storeu_si128((__m128i *)(out + 2 * i), _mm_unpacklo_epi8(hi, lo));
+        _mm_storeu_si128((__m128i *)(out + 2 * i + 16),
+                         _mm_unpackhi_epi8(hi, lo));
+    }
+    hex_scalar(in + i, n - i, out + 2 * i);
+}
+
+/* the candidates at h among 16 that match the first and the last byte */
+static inline __m128i
+find_eq_sse2(const char *h, size_t m, __m128i first, __m128i last)
+{
+    __m128i f = _mm_loadu_si128((const __m128i *)h);
+    __m128i l = _mm_loadu_si128((const __m128i *)(h + m - 1));
+
+    return _mm_and_si128(_mm_cmpeq_epi8(f, first), _mm_cmpeq_epi8(l, last));
+}
+
+static inline size_t
+find_sse2(const char *h, size_t n, const char *p, size_t m)
+{
+    __m128i first = _mm_set1_epi8(p[0]);
+    __m128i last = _mm_set1_epi8(p[m - 1]);
+    size_t i = 0;
+
+    /* 64 candidates at a time, with one movemask for the four vectors */
+    for (; i + m - 1 + 64 <= n; i += 64) {
+        __m128i e0 = find_eq_sse2(h + i, m, first, last);
+        __m128i e1 = find_eq_sse2(h + i + 16, m, first, last);
+        __m128i e2 = find_eq_sse2(h + i + 32, m, first, last);
+        __m128i e3 = find_eq_sse2(h + i + 48, m, first, last);
+
+        if (_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(e0, e1),
+                                           _mm_or_si128(e2, e3))) == 0)
+            continue;
+        uint64_t mask = (uint64_t)(unsigned int)_mm_movemask_epi8(e0) |
+                        (uint64_t)(unsigned int)_mm_movemask_epi8(e1) << 16 |
+                        (uint64_t)(unsigned int)_mm_movemask_epi8(e2) << 32 |
+                        (uint64_t)(unsigned int)_mm_movemask_epi8(e3) << 48;
+
+        for (; mask != 0; mask &= mask - 1) {
+            size_t at = i + (size_t)__builtin_ctzll(mask);
+            if (find_check(h + at, p, m))
+                return at;
+        }
+    }
+    for (; i + m - 1 + 16 <= n; i += 16) {
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(
+            find_eq_sse2(h + i, m, first, last));
+
+        for (; mask != 0; mask &= mask - 1) {
+            size_t at = i + (size_t)__builtin_ctz(mask);
+            if (find_check(h + at, p, m))
+                return at;
+        }
+    }
+    return i + find_scalar(h + i, n - i, p, m);
+}
+#endif /* KERNELS_SSE2 */
+
+/* AVX2 kernels */
+
+#ifdef KERNELS_AVX2
+#define KERNELS_AVX2_FN __attribute__((target("avx2")))
+
+static inline bool
+avx2_supported(void)
+{
+    return __builtin_cpu_supports("avx2");
+}
+
+KERNELS_AVX2_FN static inline __m256i
+range_avx2(__m256i x, unsigned char lo, unsigned char len)
+{
+    __m256i t = _mm256_sub_epi8(x, _mm256_set1_epi8((char)lo));
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8((char)len)),
+                             t);
+}
+
+KERNELS_AVX2_FN static inline void
+map_avx2(const struct byte_map *m, char *buf, size_t n)
+{
+    size_t i = 0;
+
+    if (m->nranges == 0) {
+        map_scalar(m, buf, n);
+        return;
+    }
+    for (; i + 32 <= n; i += 32) {
+        __m256i x = _mm256_loadu_si256((__m256i *)(buf + i));
+        __m256i r = x;
+        for (unsigned int k = 0; k < m->nranges; k++) {
+            __m256i d = _mm256_set1_epi8((char)m->delta[k]);
+            __m256i in = range_avx2(x, m->lo[k], m->len[k]);
+            r = _mm256_add_epi8(r, _mm256_and_si256(in, d));
+        }
+        _mm256_storeu_si256((__m256i *)(buf + i), r);
+    }
+    map_scalar(m, buf + i, n - i);
+}
+
+KERNELS_AVX2_FN static inline void
+fold_avx2(char *buf, size_t n, bool upper)
+{
+    unsigned char lo = upper ? 'a' : 'A';
+    __m256i d = _mm256_set1_epi8(upper ? -32 : 32);
+    size_t i = 0;
+
+    for (; i + 32 <= n; i += 32) {
+        __m256i x = _mm256_loadu_si256((__m256i *)(buf + i));
+        __m256i in = range_avx2(x, lo, 25);
+        x = _mm256_add_epi8(x, _mm256_and_si256(in, d));
+        _mm256_storeu_si256((__m256i *)(buf + i), x);
+    }
+    fold_scalar(buf + i, n - i, upper);
+}
+
+KERNELS_AVX2_FN static inline __m256i
+special_avx2(__m256i x)
+{
+    __m256i ctl = _mm256_cmpgt_epi8(_mm256_set1_epi8(32), x);
+    __m256i del = _mm256_cmpeq_epi8(x, _mm256_set1_epi8(127));
+    __m256i tab = _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\t'));
+    __m256i nl = _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\n'));
+    return _mm256_andnot_si256(_mm256_or_si256(tab, nl),
+                               _mm256_or_si256(ctl, del));
+}
+
+KERNELS_AVX2_FN static inline size_t
+escape_avx2(const char *in, size_t n, char *out)
+{
+    size_t i = 0, o = 0;
+
+    for (; i + 32 <= n; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(in + i));
+        if (_mm256_movemask_epi8(special_avx2(x)) == 0) {
+            _mm256_storeu_si256((__m256i *)(out + o), x);
+            o += 32;
+        } else {
+            o += escape_scalar(in + i, 32, out + o);
+        }
+    }
+    return o + escape_scalar(in + i, n - i, out + o);
+}
+
+KERNELS_AVX2_FN static inline uint64_t
+eol_avx2(const char *p)
+{
+    __m256i nl = _mm256_set1_epi8('\n');
+    __m256i lo = _mm256_loadu_si256((const __m256i *)p);
+    __m256i hi = _mm256_loadu_si256((const __m256i *)(p + 32));
+    uint32_t mlo = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, nl));
+    uint32_t mhi = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, nl));
+    return (uint64_t)mhi << 32 | mlo;
+}
+
+KERNELS_AVX2_FN static inline void
+words_avx2(const char *p, uint64_t *space, uint64_t *graph)
+{
+    __m256i sp = _mm256_set1_epi8(' ');
+    uint64_t s = 0, g = 0;
+
+    for (int i = 0; i < EOL_BLOCK; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(p + i));
+        __m256i ws = _mm256_or_si256(_mm256_cmpeq_epi8(x, sp),
+                                     range_avx2(x, '\t', '\r' - '\t'));
+        __m256i gr = range_avx2(x, '!', '~' - '!');
+        s |= (uint64_t)(uint32_t)_mm256_movemask_epi8(ws) << i;
+        g |= (uint64_t)(uint32_t)_mm256_movemask_epi8(gr) << i;
+    }
+    *space = s;
+    *graph = g;
+}
+
+KERNELS_AVX2_FN static inline void
+hex_avx2(const char *in, size_t n, char *out)
+{
+    __m256i digits = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128((const __m128i *)hex_digits));
+    __m256i low = _mm256_set1_epi8(15);
+    size_t i = 0;
+
+    for (; i + 32 <= n; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(in + i));
+        __m256i hi = _mm256_shuffle_epi8(
+            digits, _mm256_and_si256(_mm256_srli_epi16(x, 4), low));
+        __m256i lo = _mm256_shuffle_epi8(digits, _mm256_and_si256(x, low));
+
+        /* the unpacks work within 128-bit lanes, put the lanes in order */
+        __m256i a = _mm256_unpacklo_epi8(hi, lo);
+        __m256i b = _mm256_unpackhi_epi8(hi, lo);
+        _mm256_storeu_si256((__m256i *)(out + 2 * i),
+                            _mm256_permute2x128_si256(a, b, 0x20));
+        _mm256_storeu_si256((__m256i *)(out + 2 * i + 32),
+                            _mm256_permute2x128_si256(a, b, 0x31));
+    }
+    hex_scalar(in + i, n - i, out + 2 * i);
+}
+
+/* 24 bytes in, 32 characters out.  Each lane takes 12 bytes, and each 3 bytes
+ * abc are shuffled to bacb so that the 16-bit words ab and bc hold the four
+ * 6-bit fields, which mulhi and mullo shift to a byte each. */
+KERNELS_AVX2_FN static inline void
+base64_avx2(const char *in, size_t n, char *out)
+{
+    __m256i spread = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10,
+                                      9, 11, 10, 1, 0, 2, 1, 4, 3, 5, 4, 7, 6,
+                                      8, 7, 10, 9, 11, 10);
+    /* offset from the 6-bit value to its character, by range: 26-51, 52-61
+     * (one entry each), 62, 63, 0-25 */
+    __m256i offset = _mm256_setr_epi8(71, -4, -4, -4, -4, -4, -4, -4, -4, -4,
+                                      -4, -19, -16, 65, 0, 0, 71, -4, -4, -4,
+                                      -4, -4, -4, -4, -4, -4, -4, -19, -16, 65,
+                                      0, 0);
+    size_t i = 0;
+
+    /* the second lane reads 4 bytes past the 24 it encodes */
+    for (; i + 28 <= n; i += 24, out += 32) {
+        __m256i x = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(in + i))),
+            _mm_loadu_si128((const __m128i *)(in + i + 12)), 1);
+        x = _mm256_shuffle_epi8(x, spread);
+
+        __m256i f02 = _mm256_mulhi_epu16(
+            _mm256_and_si256(x, _mm256_set1_epi32(0x0fc0fc00)),
+            _mm256_set1_epi32(0x04000040));
+        __m256i f13 = _mm256_mullo_epi16(
+            _mm256_and_si256(x, _mm256_set1_epi32(0x003f03f0)),
+            _mm256_set1_epi32(0x01000010));
+        __m256i f = _mm256_or_si256(f02, f13);
+
+        __m256i range = _mm256_subs_epu8(f, _mm256_set1_epi8(51));
+        __m256i upper = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), f);
+        range = _mm256_or_si256(range,
+                                _mm256_and_si256(upper, _mm256_set1_epi8(13)));
+        f = _mm256_add_epi8(f, _mm256_shuffle_epi8(offset, range));
+        _mm256_storeu_si256((__m256i *)out, f);
+    }
+    base64_scalar(in + i, n - i, out);
+}
+
+/* the candidates at h among 32 that match the first and the last byte */
+KERNELS_AVX2_FN static inline __m256i
+find_eq_avx2(const char *h, size_t m, __m256i first, __m256i last)
+{
+    __m256i f = _mm256_loadu_si256((const __m256i *)h);
+    __m256i l = _mm256_loadu_si256((const __m256i *)(h + m - 1));
+
+    return _mm256_and_si256(_mm256_cmpeq_epi8(f, first),
+                            _mm256_cmpeq_epi8(l, last));
+}
+
+KERNELS_AVX2_FN static inline size_t
+find_avx2(const char *h, size_t n, const char *p, size_t m)
+{
+    __m256i first = _mm256_set1_epi8(p[0]);
+    __m256i last = _mm256_set1_epi8(p[m - 1]);
+    size_t i = 0;
+
+    /* 64 candidates at a time, with one test for the two vectors */
+    for (; i + m - 1 + 64 <= n; i += 64) {
+        __m256i e0 = find_eq_avx2(h + i, m, first, last);
+        __m256i e1 = find_eq_avx2(h + i + 32, m, first, last);
+
+        if (_mm256_testz_si256(_mm256_or_si256(e0, e1),
+                               _mm256_or_si256(e0, e1)))
+            continue;
+        uint64_t mask =
+            (uint64_t)(unsigned int)_mm256_movemask_epi8(e0) |
+            (uint64_t)(unsigned int)_mm256_movemask_epi8(e1) << 32;
+
+        for (; mask != 0; mask &= mask - 1) {
+            size_t at = i + (size_t)__builtin_ctzll(mask);
+            if (find_check(h + at, p, m))
+                return at;
+        }
+    }
+    for (; i + m - 1 + 32 <= n; i += 32) {
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(
+            find_eq_avx2(h + i, m, first, last));
+
+        for (; mask != 0; mask &= mask - 1) {
+            size_t at = i + (size_t)__builtin_ctz(mask);
+            if (find_check(h + at, p, m))
+                return at;
+        }
+    }
+    return i + find_scalar(h + i, n - i, p, m);
+}
+#endif /* KERNELS_AVX2 */
+
+/* NEON kernels */
+
+#ifdef KERNELS_NEON
+static inline uint8x16_t
+range_neon(uint8x16_t x, unsigned char lo, unsigned char len)
+{
+    return vcleq_u8(vsubq_u8(x, vdupq_n_u8(lo)), vdupq_n_u8(len));
+}
+
+static inline void
+map_neon(const struct byte_map *m, char *buf, size_t n)
+{
+    size_t i = 0;
+
+    if (m->nranges == 0) {
+        map_scalar(m, buf, n);
+        return;
+    }
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t x = vld1q_u8((uint8_t *)buf + i);
+        uint8x16_t r = x;
+        for (unsigned int k = 0; k < m->nranges; k++) {
+            uint8x16_t in = range_neon(x, m->lo[k], m->len[k]);
+            r = vaddq_u8(r, vandq_u8(in, vdupq_n_u8(m->delta[k])));
+        }
+        vst1q_u8((uint8_t *)buf + i, r);
+    }
+    map_scalar(m, buf + i, n - i);
+}
+
+static inline void
+fold_neon(char *buf, size_t n, bool upper)
+{
+    unsigned char lo = upper ? 'a' : 'A';
+    uint8x16_t d = vdupq_n_u8(upper ? (unsigned char)-32 : 32);
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t x = vld1q_u8((uint8_t *)buf + i);
+        x = vaddq_u8(x, vandq_u8(range_neon(x, lo, 25), d));
+        vst1q_u8((uint8_t *)buf + i, x);
+    }
+    fold_scalar(buf + i, n - i, upper);
+}
+
+static inline uint8x16_t
+special_neon(uint8x16_t x)
+{
+    uint8x16_t ctl = vcltq_u8(x, vdupq_n_u8(32));
+    uint8x16_t high = vcgeq_u8(x, vdupq_n_u8(127));
+    uint8x16_t tab = vceqq_u8(x, vdupq_n_u8('\t'));
+    uint8x16_t nl = vceqq_u8(x, vdupq_n_u8('\n'));
+    return vbicq_u8(vorrq_u8(ctl, high), vorrq_u8(tab, nl));
+}
+
+static inline size_t
+escape_neon(const char *in, size_t n, char *out)
+{
+    size_t i = 0, o = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t x = vld1q_u8((const uint8_t *)in + i);
+        if (vmaxvq_u8(special_neon(x)) == 0) {
+            vst1q_u8((uint8_t *)out + o, x);
+            o += 16;
+        } else {
+            o += escape_scalar(in + i, 16, out + o);
+        }
+    }
+    return o + escape_scalar(in + i, n - i, out + o);
+}
+
+/* NEON has no movemask, keep one bit per byte and add neighbours pairwise */
+static inline uint64_t
+mask_neon(const uint8x16_t eq[4])
+{
+    static const uint8_t bit[16] = {1, 2, 4, 8, 16, 32, 64, 128,
+                                    1, 2, 4, 8, 16, 32, 64, 128};
+    uint8x16_t b = vld1q_u8(bit);
+    uint8x16_t t[4];
+
+    for (int i = 0; i < 4; i++)
+        t[i] = vandq_u8(eq[i], b);
+    uint8x16_t s = vpaddq_u8(vpaddq_u8(t[0], t[1]), vpaddq_u8(t[2], t[3]));
+    s = vpaddq_u8(s, s);
+    return vgetq_lane_u64(vreinterpretq_u64_u8(s), 0);
+}
+
+static inline uint64_t
+eol_neon(const char *p)
+{
+    uint8x16_t nl = vdupq_n_u8('\n');
+    uint8x16_t eq[4];
+
+    for (int i = 0; i < 4; i++)
+        eq[i] = vceqq_u8(vld1q_u8((const uint8_t *)p + 16 * i), nl);
+    return mask_neon(eq);
+}
+
+static inline void
+words_neon(const char *p, uint64_t *space, uint64_t *graph)
+{
+    uint8x16_t sp = vdupq_n_u8(' ');
+    uint8x16_t ws[4], gr[4];
+
+    for (int i = 0; i < 4; i++) {
+        uint8x16_t x = vld1q_u8((const uint8_t *)p + 16 * i);
+        ws[i] = vorrq_u8(vceqq_u8(x, sp), range_neon(x, '\t', '\r' - '\t'));
+        gr[i] = range_neon(x, '!', '~' - '!');
+    }
+    *space = mask_neon(ws);
+    *graph = mask_neon(gr);
+}
+
+static inline void
+hex_neon(const char *in, size_t n, char *out)
+{
+    uint8x16_t digits = vld1q_u8((const uint8_t *)hex_digits);
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t x = vld1q_u8((const uint8_t *)in + i);
+        uint8x16x2_t h;
+        h.val[0] = vqtbl1q_u8(digits, vshrq_n_u8(x, 4));
+        h.val[1] = vqtbl1q_u8(digits, vandq_u8(x, vdupq_n_u8(15)));
+        vst2q_u8((uint8_t *)out + 2 * i, h);
+    }
+    hex_scalar(in + i, n - i, out + 2 * i);
+}
+
+/* 48 bytes in, 64 characters out */
+static inline void
+base64_neon(const char *in, size_t n, char *out)
+{
+    uint8x16x4_t digits;
+    uint8x16_t m = vdupq_n_u8(63);
+    size_t i = 0;
+
+    for (int k = 0; k < 4; k++)
+        digits.val[k] = vld1q_u8((const uint8_t *)base64_digits + 16 * k);
+    for (; i + 48 <= n; i += 48, out += 64) {
+        uint8x16x3_t x = vld3q_u8((const uint8_t *)in + i);
+        uint8x16x4_t f;
+        f.val[0] = vshrq_n_u8(x.val[0], 2);
+        f.val[1] = vandq_u8(
+            vorrq_u8(vshlq_n_u8(x.val[0], 4), vshrq_n_u8(x.val[1], 4)), m);
+        f.val[2] = vandq_u8(
+            vorrq_u8(vshlq_n_u8(x.val[1], 2), vshrq_n_u8(x.val[2], 6)), m);
+        f.val[3] = vandq_u8(x.val[2], m);
+        for (int k = 0; k < 4; k++)
+            f.val[k] = vqtbl4q_u8(digits, f.val[k]);
+        vst4q_u8((uint8_t *)out, f);
+    }
+    base64_scalar(in + i, n - i, out);
+}
+
+/* the mask has 4 bits per byte, narrowed from the 16-bit lanes, only the
+ * top one is kept */
+static inline size_t
+find_neon(const char *h, size_t n, const char *p, size_t m)
+{
+    uint8x16_t first = vdupq_n_u8((uint8_t)p[0]);
+    uint8x16_t last = vdupq_n_u8((uint8_t)p[m - 1]);
+    size_t i = 0;
+
+    for (; i + m - 1 + 16 <= n; i += 16) {
+        uint8x16_t f = vld1q_u8((const uint8_t *)h + i);
+        uint8x16_t l = vld1q_u8((const uint8_t *)h + i + m - 1);
+        uint8x16_t eq = vandq_u8(vceqq_u8(f, first), vceqq_u8(l, last));
+        uint64_t mask = vget_lane_u64(
+            vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+
+        mask &= 0x8888888888888888ULL;
+        for (; mask != 0; mask &= mask - 1) {
+            size_t at = i + (size_t)__builtin_ctzll(mask) / 4;
+            if (find_check(h + at, p, m))
+                return at;
+        }
+    }
+    return i + find_scalar(h + i, n - i, p, m);
+}
+#endif /* KERNELS_NEON */
+
+/* kernel variants, the best supported one comes first */
+
+struct kernels {
+    const char *isa;
+    bool (*supported)(void);
+    void (*map)(const struct byte_map *m, char *buf, size_t n);
+    void (*fold)(char *buf, size_t n, bool upper);
+    size_t (*escape)(const char *in, size_t n, char *out);
+    uint64_t (*eol)(const char *p);
+    void (*words)(const char *p, uint64_t *space, uint64_t *graph);
+    void (*hex)(const char *in, size_t n, char *out);
+    void (*base64)(const char *in, size_t n, char *out);
+    size_t (*find)(const char *h, size_t n, const char *p, size_t m);
+};
+
+static inline bool
+always_supported(void)
+{
+    return true;
+}
+
+static const struct kernels kernel_variants[] = {
+#ifdef KERNELS_AVX2
+    {"avx2", avx2_supported, map_avx2, fold_avx2, escape_avx2, eol_avx2,
+     words_avx2, hex_avx2, base64_avx2, find_avx2},
+#endif
+#ifdef KERNELS_SSE2
+    {"sse2", always_supported, map_sse2, fold_sse2, escape_sse2, eol_sse2,
+     words_sse2, hex_sse2, base64_scalar, find_sse2},
+#endif
+#ifdef KERNELS_NEON
+    {"neon", always_supported, map_neon, fold_neon, escape_neon, eol_neon,
+     words_neon, hex_neon, base64_neon, find_neon},
+#endif
+    {"scalar", always_supported, map_scalar, fold_scalar, escape_scalar,
+     eol_scalar, words_scalar, hex_scalar, base64_scalar, find_scalar},
+};
+
+#define KERNEL_VARIANTS (sizeof(kernel_variants) / sizeof(kernel_variants[0]))
+
+/* returns the best kernels supported by the running cpu */
+static inline const struct kernels *
+kernels_best(void)
+{
+    for (size_t i = 0; i < KERNEL_VARIANTS; i++)
+        if (kernel_variants[i].supported())
+            return &kernel_variants[i];
+    return &kernel_variants[KERNEL_VARIANTS - 1];
+}
+
+#endif
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) Huawei Technologies Co., Ltd. 2026. All rights reserved.
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef LATENCY_H
+#define LATENCY_H
+/*******************************************************************************
+ * Log-linear latency histograms, as in HdrHistogram.
+ *
+ * Values below 2 * LATENCY_SUB nanoseconds have a bucket each.  Above, the
+ * values from 2^m to 2^(m+1) - 1 share LATENCY_SUB buckets of equal width, so
+ * that a bucket is never wider than 1/LATENCY_SUB (3%) of its values, and
+ * percentiles keep that precision from nanoseconds to minutes with a fixed
+ * number of buckets.  Values of 2^LATENCY_MAX_BITS ns (18 minutes) and more
+ * share the last bucket.
+ *
+ * A histogram has a single writer and no atomics: each thread records into
+ * its own, and they are merged once the threads are done.
+ ******************************************************************************/
+#include <stdint.h>
+#include <stdio.h>
+
+#include "now.h"
+
+#define LATENCY_SUB_BITS 5
+#define LATENCY_SUB (1U << LATENCY_SUB_BITS)
+#define LATENCY_MAX_BITS 40
+#define LATENCY_BUCKETS                                                        \
+    ((LATENCY_MAX_BITS - LATENCY_SUB_BITS + 1) * LATENCY_SUB)
+
+struct latency_hist {
+    uint64_t count;
+    nanosec_t max;
+    uint64_t bucket[LATENCY_BUCKETS];
+};
+
+/* returns the bucket of value v */
+static inline unsigned int
+latency_index(nanosec_t v)
+{
+    unsigned int shift;
+
+    if (v < 2 * LATENCY_SUB)
+        return (unsigned int)v;
+    if (v >> LATENCY_MAX_BITS)
+        return LATENCY_BUCKETS - 1;
+    shift = 63 - (unsigned int)__builtin_clzll(v) - LATENCY_SUB_BITS;
+    return shift * LATENCY_SUB + (unsigned int)(v >> shift);
+}
+
+/* returns the highest value of bucket i */
+static inline nanosec_t
+latency_value(unsigned int i)
+{
+    unsigned int shift;
+
+    if (i < 2 * LATENCY_SUB)
+        return i;
+    shift = i / LATENCY_SUB - 1;
+    return ((nanosec_t)(i - shift * LATENCY_SUB + 1) << shift) - 1;
+}
+
+static inline void
+latency_record(struct latency_hist *h, nanosec_t v)
+{
+    h->bucket[latency_index(v)]++;
+    h->count++;
+    if (v > h->max)
+        h->max = v;
+}
+
+/* adds the values of src to dst */
+static inline void
+latency_merge(struct latency_hist *dst, const struct latency_hist *src)
+{
+    for (unsigned int i = 0; i < LATENCY_BUCKETS; i++)
+        dst->bucket[i] += src->bucket[i];
+    dst->count += src->count;
+    if (src->max > dst->max)
+        dst->max = src->max;
+}
+
+/* returns the value below which a fraction p of the values are, to the
+ * precision of the buckets */
+static inline nanosec_t
+latency_percentile(const struct latency_hist *h, double p)
+{
+    uint64_t rank = (uint64_t)(p * (double)h->count + 0.5);
+    uint64_t seen = 0;
+
+    if (rank == 0)
+        rank = 1;
+    for (unsigned int i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += h->bucket[i];
+        if (seen >= rank)
+            return latency_value(i) < h->max ? latency_value(i) : h->max;
+    }
+    return h->max;
+}
+
+static inline void
+latency_header(FILE *fp)
+{
+    fprintf(fp, "%-14s %10s %10s %10s %10s %10s\n", "latency us", "count",
+            "p50", "p99", "p999", "max");
+}
+
+/* prints the count and the percentiles of h in microseconds */
+static inline void
+latency_print(FILE *fp, const char *name, const struct latency_hist *h)
+{
+    fprintf(fp, "%-14s %10lu %10.1f %10.1f %10.1f %10.1f\n", name,
+            (unsigned long)h->count,
+            (double)latency_percentile(h, 0.5) / NOW_MICROSECOND,
+            (double)latency_percentile(h, 0.99) / NOW_MICROSECOND,
+            (double)latency_percentile(h, 0.999) / NOW_MICROSECOND,
+            (double)h->max / NOW_MICROSECOND);
+}
+
+#endif
@@ -0,0 +1,788 @@
+/*
+ * Copyright (C) Huawei Technologies Co., Ltd. 2026. All rights reserved.
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef PIPELINE_H
+#define PIPELINE_H
+/*******************************************************************************
+ * Pipeline runtime: a chain of stages, each run by one or more threads
+ * (instances), connected by rings.
+ *
+ * A pipeline is declared as an array of stages with their function, number
+ * of instances and cpu, and the runtime creates the rings, the item pools and
+ * the threads:
+ *
+ * - Items start in the pools of the first stage, `pool` items per instance,
+ *   flow through the stages in order and go back to their pool (`home`) after
+ *   the last stage, which therefore has a single instance.  A later stage
+ *   with one instance may have pools too, for items it makes of its own.
+ * - Items go from the instances of a stage to those of the next through one
+ *   ring per pair (lanes), round robin, skipping full lanes, or `group` items
+ *   of consecutive sequence numbers to the same instance if the next stage
+ *   sets it.
+ * - Items leave a run of stages with several instances (wide) in sequence
+ *   order, through a reorder buffer before the stage with one instance that
+ *   follows the run.  Items are admitted to that buffer before they enter
+ *   the run, so that a slow instance throttles the others.
+ * - The first stage fills items and returns false once it has nothing left.
+ *   With one instance, the runtime numbers the items; with several, the
+ *   stage function sets seq, and the numbers must be dense from 0.  When all
+ *   instances are done, the runtime sends an end of stream marker (eof set),
+ *   numbered after the last item, which every stage sees once.  Instances of
+ *   a wide stage that do not get the marker stop when the last stage is done.
+ * - pipeline_init() fuses stages into steps, runs of adjacent stages whose
+ *   functions one thread calls in turn on each item, which saves a thread and
+ *   a ring hop per item.  A stage without a function only passes items on and
+ *   joins the step before it, unless it is the last.  A stage with `fuse` set
+ *   joins the step before it if both have one instance, so that a cheap stage
+ *   does not cost a cross-core transfer.  A stage with a loop, pools or a
+ *   group of its own keeps its threads, and so does every stage when
+ *   `unfused` is set.  A step takes its instances, cpu, wait policy and ring
+ *   variant from its first stage.
+ *
+ * Instead of a function, a stage may run a loop of its own (`run`), to batch
+ * items, to read its input in its own way or to make items: the first stage
+ * takes empty items with pipeline_new(), the others take items from the step
+ * before with pipeline_get() or pipeline_take(), all pass them on with
+ * pipeline_pass(), and the instances of the first stage end the stream with
+ * pipeline_end().
+ *
+ * Each stage takes its items from rings of its own variant: by default the
+ * one the program includes before this header, as with ccat.c, or the
+ * sequentially consistent ringbuf_spsc_sc.h or the acquire-release
+ * ringbuf_spsc_opt.h, which this header includes again under the prefixes
+ * ringbuf_sc_ and ringbuf_opt_, so that the variants can be compared edge by
+ * edge in one program.  The statistics and the flight recorder only see the
+ * operations on the included variant, whose ringbuf_enq() and ringbuf_deq()
+ * they redefine.  The pools are rings of the variant of their stage.  Each
+ * stage waits for room or items with its wait policy (see wait.h), spinning
+ * by default.  With `pin` set, pipeline_init() places every instance with
+ * placement.h, on its stage's cpu if it has one, or else next to the instance
+ * before it in pipeline order, and puts the items of each pool on the NUMA
+ * node of its instance and the slots of each ring on that of the instance
+ * that enqueues to it.
+ ******************************************************************************/
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vsync/atomic.h>
+
+#include "arena.h"
+#include "placement.h"
+#include "reorder.h"
+#include "ringbuf.h"
+#include "wait.h"
+
+/* the SPSC variants under prefixes of their own, next to the included one:
+ * their guard is that of every variant, and the macros that stats.h and
+ * flight.h put over ringbuf_enq() and ringbuf_deq() are set aside meanwhile */
+#pragma push_macro("ringbuf_enq")
+#pragma push_macro("ringbuf_deq")
+#undef ringbuf_enq
+#undef ringbuf_deq
+
+#undef RINGBUF_H
+#define ringbuf_t ringbuf_sc_t
+#define ringbuf_init ringbuf_sc_init
+#define ringbuf_enq ringbuf_sc_enq
+#define ringbuf_deq ringbuf_sc_deq
+#include "ringbuf_spsc_sc.h"
+#undef ringbuf_t
+#undef ringbuf_init
+#undef ringbuf_enq
+#undef ringbuf_deq
+
+#undef RINGBUF_H
+#define ringbuf_t ringbuf_opt_t
+#define ringbuf_init ringbuf_opt_init
+#define ringbuf_enq ringbuf_opt_enq
+#define ringbuf_deq ringbuf_opt_deq
+#include "ringbuf_spsc_opt.h"
+#undef ringbuf_t
+#undef ringbuf_init
+#undef ringbuf_enq
+#undef ringbuf_deq
+
+#pragma pop_macro("ringbuf_enq")
+#pragma pop_macro("ringbuf_deq")
+
+/* ring variants a stage can take its items from */
+enum ring_variant {
+    RING_INCLUDED, /* the ringbuf.h variant included by the program */
+    RING_SC,       /* sequentially consistent, ringbuf_spsc_sc.h */
+    RING_OPT,      /* acquire and release, ringbuf_spsc_opt.h */
+    RING_VARIANTS,
+};
+
+static const char *ring_names[RING_VARIANTS] = {"included", "sc", "opt"};
+
+/* returns the variant called name, or -1 */
+static inline int
+ring_find(const char *name)
+{
+    for (int v = 0; v < RING_VARIANTS; v++)
+        if (strcmp(name, ring_names[v]) == 0)
+            return v;
+    return -1;
+}
+
+/* a single producer, single consumer ring of the given variant */
+struct pipeline_ring {
+    enum ring_variant variant;
+    union {
+        ringbuf_t included;
+        ringbuf_sc_t sc;
+        ringbuf_opt_t opt;
+    };
+};
+
+/* header of the items, at the start of the program's item struct */
+struct pipeline_item {
+    unsigned int seq;           /* position in the stream */
+    bool eof;                   /* end of stream marker */
+    struct pipeline_ring *home; /* pool the item goes back to */
+};
+
+struct pipeline_worker;
+
+/* the first stage fills it and returns false at the end of the stream, the
+ * other stages process it, or see the end of stream marker */
+typedef bool (*stage_fn)(void *arg, unsigned int instance,
+                         struct pipeline_item *it);
+
+/* the loop of an instance of a stage that takes and passes items itself */
+typedef void (*stage_run)(struct pipeline_worker *w);
+
+struct stage {
+    const char *name;
+    stage_fn fn;   /* NULL to only pass items on, except for the first stage */
+    stage_run run; /* loop run instead of fn, or NULL */
+    void *arg;
+    unsigned int instances;
+    unsigned int pool;  /* items per instance, 0 for none but the first */
+    unsigned int group; /* items that go to the same instance, 0 for one */
+    int cpu; /* cpu of the first instance, the others follow, -1 for any */
+    enum wait_policy wait;
+    enum ring_variant ring; /* of the rings the stage takes items from */
+    bool fuse;              /* run on the thread of the stage before */
+};
+
+/* stages run by the same threads, one after the other */
+struct pipeline_step {
+    struct stage *stage;
+    unsigned int nstages;
+    unsigned int worker; /* index of the first instance in workers */
+};
+
+/* items owned by an instance, in the items arena from first on */
+struct pipeline_pool {
+    struct pipeline_ring ring;
+    unsigned int first;
+    unsigned int len;
+    int cpu; /* of the instance, -1 if not pinned */
+};
+
+/* edge from step s to step s + 1, through lanes, a row per instance of s
+ * and a column per instance of s + 1, or through a reorder buffer */
+struct pipeline_link {
+    bool ordered; /* s is wide and s + 1 is not, see above */
+    struct pipeline_ring *lanes;
+    reorder_t order;
+    reorder_t *admit; /* buffer the items are admitted to first, or NULL */
+};
+
+struct pipeline_worker {
+    struct pipeline *p;
+    unsigned int step;
+    unsigned int instance;
+    unsigned int lane;          /* next lane to put to */
+    unsigned int cursor;        /* next lane to get from */
+    unsigned int seq;           /* next item of a first step of one instance */
+    struct pipeline_pool *pool; /* NULL if the stage has none */
+    int cpu;                    /* -1 if not pinned */
+    struct waiter wait;
+    pthread_t thread;
+};
+
+struct pipeline {
+    /* set by the program */
+    struct stage *stages;
+    unsigned int nstages;
+    size_t item_size; /* at least sizeof(struct pipeline_item) */
+    unsigned int ring_len;
+    unsigned int reorder_len; /* a power of two */
+    bool pin;                 /* pin the instances, see above */
+    int place_flags;          /* PLACE_* flags of placement.h */
+    int arena_flags;          /* ARENA_* flags of arena.h, for the items */
+    bool unfused;             /* keep every stage on threads of its own */
+
+    /* set by the runtime */
+    struct pipeline_step *steps;
+    unsigned int nsteps;
+    struct pipeline_link *links;
+    struct pipeline_pool *pools;
+    unsigned int npools;
+    unsigned int nitems;
+    struct arena items; /* all pools, one cache-aligned item after another */
+    struct arena rings; /* the slots of the rings, one object per ring */
+    unsigned int nrings;
+    struct pipeline_worker *workers;
+    unsigned int nworkers;
+    struct placement placement;
+    vatomic32_t produced; /* items of a wide first stage */
+    vatomic32_t sources;  /* instances of the first stage still running */
+    vatomic32_t finished; /* the last stage got the end of stream marker */
+};
+
+static inline void *
+pipeline_alloc(size_t n)
+{
+    void *m = calloc(1, n);
+    if (m == NULL) {
+        perror("pipeline malloc");
+        exit(EXIT_FAILURE);
+    }
+    return m;
+}
+
+static inline void
+pipeline_ring_init(struct pipeline_ring *r, enum ring_variant variant,
+                   void **buf, unsigned int len)
+{
+    r->variant = variant;
+    switch (variant) {
+    case RING_SC:
+        ringbuf_sc_init(&r->sc, buf, len);
+        break;
+    case RING_OPT:
+        ringbuf_opt_init(&r->opt, buf, len);
+        break;
+    default:
+        ringbuf_init(&r->included, buf, len);
+    }
+}
+
+static inline int
+pipeline_ring_enq(struct pipeline_ring *r, void *v)
+{
+    switch (r->variant) {
+    case RING_SC:
+        return ringbuf_sc_enq(&r->sc, v);
+    case RING_OPT:
+        return ringbuf_opt_enq(&r->opt, v);
+    default:
+        return ringbuf_enq(&r->included, v);
+    }
+}
+
+static inline int
+pipeline_ring_deq(struct pipeline_ring *r, void **v)
+{
+    switch (r->variant) {
+    case RING_SC:
+        return ringbuf_sc_deq(&r->sc, v);
+    case RING_OPT:
+        return ringbuf_opt_deq(&r->opt, v);
+    default:
+        return ringbuf_deq(&r->included, v);
+    }
+}
+
+static inline struct pipeline_item *
+pipeline_item_at(struct pipeline *p, unsigned int i)
+{
+    return (struct pipeline_item *)arena_at(&p->items, i);
+}
+
+/* returns the first stage of step s */
+static inline struct stage *
+pipeline_head(struct pipeline *p, unsigned int s)
+{
+    return p->steps[s].stage;
+}
+
+/* returns true if step s has several instances */
+static inline bool
+pipeline_wide(struct pipeline *p, unsigned int s)
+{
+    return pipeline_head(p, s)->instances > 1;
+}
+
+/* returns the NUMA node of cpu, or -1 without placement */
+static inline int
+pipeline_node(struct pipeline *p, int cpu)
+{
+    return p->pin ? placement_node(&p->placement, cpu) : -1;
+}
+
+/* returns the cpu of instance i of the step that runs stage k, or -1 */
+static inline int
+pipeline_stage_cpu(struct pipeline *p, unsigned int k, unsigned int i)
+{
+    unsigned int s = p->nsteps - 1;
+
+    while (pipeline_head(p, s) > &p->stages[k])
+        s--;
+    i %= pipeline_head(p, s)->instances;
+    return p->workers[p->steps[s].worker + i].cpu;
+}
+
+/* groups the stages into steps, fusing each stage that can be into the step
+ * before it, see above */
+static inline void
+pipeline_fuse(struct pipeline *p)
+{
+    struct stage *st = p->stages;
+    unsigned int n = p->nstages, k = 1;
+
+    p->steps = pipeline_alloc(sizeof(struct pipeline_step) * n);
+    p->steps[0] = (struct pipeline_step){st, 1};
+    for (unsigned int s = 1; s < n; s++) {
+        struct pipeline_step *prev = &p->steps[k - 1];
+        bool join;
+
+        if (p->unfused || st[s].run != NULL || st[s].pool > 0 ||
+            st[s].group > 0)
+            join = false;
+        else if (st[s].fn == NULL)
+            join = s + 1 < n;
+        else
+            join = st[s].fuse && st[s].instances == 1 &&
+                   prev->stage->instances == 1;
+        if (join)
+            prev->nstages++;
+        else
+            p->steps[k++] = (struct pipeline_step){&st[s], 1};
+    }
+    p->nsteps = k;
+}
+
+/* returns an error message if the pipeline cannot be built, or NULL */
+static inline const char *
+pipeline_check(struct pipeline *p)
+{
+    struct stage *st = p->stages;
+    unsigned int n = p->nstages;
+
+    if (n < 2 || st[n - 1].instances != 1 ||
+        (st[0].fn == NULL && st[0].run == NULL) || st[0].pool == 0)
+        return "a pipeline starts with a function and a pool and ends with "
+               "a stage of one instance";
+    for (unsigned int s = 0; s < n; s++) {
+        if (st[s].instances == 0)
+            return "a stage has no instance";
+        if (s > 0 && st[s].pool > 0 && st[s].instances > 1)
+            return "a stage with pools after the first has one instance";
+    }
+    return NULL;
+}
+
+/* takes the slots of the next ring from the ring arena, on the node of cpu */
+static inline void **
+pipeline_slots(struct pipeline *p, int cpu)
+{
+    arena_bind(&p->rings, p->nrings, 1, pipeline_node(p, cpu));
+    return (void **)arena_at(&p->rings, p->nrings++);
+}
+
+/* creates the workers of the steps, placed one after the other */
+static inline void
+pipeline_workers(struct pipeline *p)
+{
+    unsigned int k = 0;
+    int cpu = -1;
+
+    p->nworkers = 0;
+    for (unsigned int s = 0; s < p->nsteps; s++)
+        p->nworkers += pipeline_head(p, s)->instances;
+    p->workers = pipeline_alloc(sizeof(struct pipeline_worker) * p->nworkers);
+    if (p->pin)
+        placement_init(&p->placement, p->place_flags);
+    for (unsigned int s = 0; s < p->nsteps; s++) {
+        struct stage *h = pipeline_head(p, s);
+
+        p->steps[s].worker = k;
+        for (unsigned int i = 0; i < h->instances; i++) {
+            struct pipeline_worker *w = &p->workers[k++];
+
+            *w = (struct pipeline_worker){.p = p, .step = s, .instance = i};
+            if (p->pin)
+                cpu = h->cpu >= 0 ? h->cpu + (int)i
+                                  : placement_next(&p->placement, cpu);
+            w->cpu = cpu;
+        }
+    }
+}
+
+/* fills the pools of the steps that have some, each on the node of its
+ * instance, with its ring on that of the last step, which gives the items
+ * back */
+static inline void
+pipeline_pools(struct pipeline *p)
+{
+    int last = p->workers[p->nworkers - 1].cpu;
+    struct pipeline_pool *pool;
+    unsigned int first = 0;
+
+    p->npools = p->nitems = 0;
+    for (unsigned int s = 0; s < p->nsteps; s++) {
+        struct stage *h = pipeline_head(p, s);
+
+        if (h->pool > 0) {
+            p->npools += h->instances;
+            p->nitems += h->pool * h->instances;
+        }
+    }
+    p->pools = pipeline_alloc(sizeof(struct pipeline_pool) * p->npools);
+    arena_init(&p->items, p->nitems, p->item_size, p->arena_flags);
+    pool = p->pools;
+    for (unsigned int s = 0; s < p->nsteps; s++) {
+        struct stage *h = pipeline_head(p, s);
+
+        for (unsigned int i = 0; h->pool > 0 && i < h->instances; i++) {
+            struct pipeline_worker *w = &p->workers[p->steps[s].worker + i];
+
+            *pool = (struct pipeline_pool){.first = first,
+                                           .len = h->pool,
+                                           .cpu = w->cpu};
+            w->pool = pool;
+            pipeline_ring_init(&pool->ring, h->ring, pipeline_slots(p, last),
+                               h->pool);
+            arena_bind(&p->items, first, h->pool, pipeline_node(p, w->cpu));
+            for (unsigned int k = 0; k < h->pool; k++) {
+                struct pipeline_item *it = pipeline_item_at(p, first + k);
+                it->home = &pool->ring;
+                pipeline_ring_enq(&pool->ring, it);
+            }
+            first += h->pool;
+            pool++;
+        }
+    }
+}
+
+/* creates the lanes and reorder buffers between the steps */
+static inline void
+pipeline_links(struct pipeline *p)
+{
+    unsigned int n = p->nsteps;
+
+    /* one link too many, so that a single step does not allocate nothing */
+    p->links = pipeline_alloc(sizeof(struct pipeline_link) * n);
+    for (unsigned int s = 0; s + 1 < n; s++) {
+        struct pipeline_link *l = &p->links[s];
+        struct pipeline_worker *from = &p->workers[p->steps[s].worker];
+        struct stage *next = pipeline_head(p, s + 1);
+        unsigned int nlanes = pipeline_head(p, s)->instances * next->instances;
+
+        l->ordered = pipeline_wide(p, s) && !pipeline_wide(p, s + 1);
+        if (l->ordered) {
+            reorder_init(&l->order,
+                         (vatomicptr_t *)pipeline_slots(p, from->cpu),
+                         p->reorder_len);
+            continue;
+        }
+        l->lanes = pipeline_alloc(sizeof(struct pipeline_ring) * nlanes);
+        for (unsigned int i = 0; i < nlanes; i++)
+            pipeline_ring_init(&l->lanes[i], next->ring,
+                               pipeline_slots(p, from[i / next->instances].cpu),
+                               p->ring_len);
+    }
+
+    /* items are admitted where they enter a run of wide steps, by the first
+     * step if it is wide, to the buffer at the end of the run */
+    for (unsigned int s = 0; s + 1 < n; s++) {
+        unsigned int t = s;
+
+        if (!(s == 0 && pipeline_wide(p, 0)) &&
+            (pipeline_wide(p, s) || !pipeline_wide(p, s + 1)))
+            continue;
+        while (!p->links[t].ordered)
+            t++;
+        p->links[s].admit = &p->links[t].order;
+    }
+}
+
+/* fuses stages, checks the shape of the pipeline, places its instances and
+ * creates its rings and pools, returns -1 if the pipeline cannot be built */
+static inline int
+pipeline_init(struct pipeline *p)
+{
+    const char *err = pipeline_check(p);
+    unsigned int nrings, len = p->ring_len;
+    size_t size;
+
+    if (err != NULL) {
+        fprintf(stderr, "%s\n", err);
+        return -1;
+    }
+    pipeline_fuse(p);
+    pipeline_workers(p);
+
+    /* a pool per instance of the steps with pools, a ring per lane and a
+     * reorder buffer per wide run, each on pages of its own if pinned */
+    nrings = 0;
+    for (unsigned int s = 0; s < p->nsteps; s++) {
+        struct stage *h = pipeline_head(p, s);
+
+        if (h->pool > 0)
+            nrings += h->instances;
+        if (h->pool > len)
+            len = h->pool;
+        if (s + 1 < p->nsteps)
+            nrings += h->instances * pipeline_head(p, s + 1)->instances;
+    }
+    if (p->reorder_len > len)
+        len = p->reorder_len;
+    size = sizeof(void *) * len;
+    if (p->pin)
+        size = arena_round(size, (size_t)sysconf(_SC_PAGESIZE));
+    p->nrings = 0;
+    arena_init(&p->rings, nrings, size, p->arena_flags & ~ARENA_HUGE);
+
+    pipeline_pools(p);
+    pipeline_links(p);
+    vatomic32_init(&p->produced, 0);
+    vatomic32_init(&p->sources, p->stages[0].instances);
+    vatomic32_init(&p->finished, 0);
+    return 0;
+}
+
+/* calls the functions of the stages of the worker's step, from the k-th on */
+static inline void
+pipeline_apply(struct pipeline_worker *w, unsigned int k,
+               struct pipeline_item *it)
+{
+    struct pipeline_step *step = &w->p->steps[w->step];
+
+    for (; k < step->nstages; k++) {
+        struct stage *st = &step->stage[k];
+        if (st->fn != NULL)
+            st->fn(st->arg, w->instance, it);
+    }
+}
+
+/* takes an empty item from the worker's pool without blocking */
+static inline bool
+pipeline_new(struct pipeline_worker *w, struct pipeline_item **it)
+{
+    if (pipeline_ring_deq(&w->pool->ring, (void **)it) != RINGBUF_OK)
+        return false;
+    (*it)->eof = false;
+    return true;
+}
+
+/* passes the item on to the next step */
+static inline void
+pipeline_put(struct pipeline_worker *w, struct pipeline_item *it)
+{
+    struct pipeline_link *l = &w->p->links[w->step];
+    struct stage *next = pipeline_head(w->p, w->step + 1);
+    unsigned int nlanes = next->instances;
+    struct pipeline_ring *row = l->lanes + w->instance * nlanes;
+
+    if (l->admit != NULL)
+        wait_while(&w->wait, !reorder_admit(l->admit, it->seq));
+    if (l->ordered) {
+        reorder_put(&l->order, it->seq, it);
+        return;
+    }
+
+    /* a whole group goes to one instance, waiting for its lane */
+    if (next->group > 0) {
+        struct pipeline_ring *lane = &row[it->seq / next->group % nlanes];
+        wait_while(&w->wait, pipeline_ring_enq(lane, it) != RINGBUF_OK);
+        return;
+    }
+
+    await_while (pipeline_ring_enq(&row[w->lane], it) != RINGBUF_OK) {
+        w->lane = (w->lane + 1) % nlanes;
+        wait_pause(&w->wait);
+    }
+    wait_done(&w->wait);
+    w->lane = (w->lane + 1) % nlanes;
+}
+
+/* gets an item from the previous step without blocking */
+static inline bool
+pipeline_get(struct pipeline_worker *w, struct pipeline_item **it)
+{
+    struct pipeline_link *l = &w->p->links[w->step - 1];
+    unsigned int nrows = pipeline_head(w->p, w->step - 1)->instances;
+    unsigned int nlanes = pipeline_head(w->p, w->step)->instances;
+
+    if (l->ordered)
+        return reorder_get(&l->order, (void **)it) == RINGBUF_OK;
+    for (unsigned int i = 0; i < nrows; i++) {
+        struct pipeline_ring *lane = &l->lanes[w->cursor * nlanes];
+
+        lane += w->instance;
+        w->cursor = (w->cursor + 1) % nrows;
+        if (pipeline_ring_deq(lane, (void **)it) == RINGBUF_OK)
+            return true;
+    }
+    return false;
+}
+
+/* gets an item from the previous step, waiting for one, returns false once
+ * the last step is done, which instances of a wide step may see first */
+static inline bool
+pipeline_take(struct pipeline_worker *w, struct pipeline_item **it)
+{
+    await_while (!pipeline_get(w, it)) {
+        if (vatomic32_read_acq(&w->p->finished)) {
+            wait_done(&w->wait);
+            return false;
+        }
+        wait_pause(&w->wait);
+    }
+    wait_done(&w->wait);
+    return true;
+}
+
+/* returns true if the worker is done once it passes the item on: the marker
+ * comes last to a step of one instance, those of a wide step may still get
+ * items after it and go on until pipeline_take() returns false */
+static inline bool
+pipeline_stops(struct pipeline_worker *w, struct pipeline_item *it)
+{
+    return it->eof && !pipeline_wide(w->p, w->step);
+}
+
+/* gives an item the last step is done with back to its pool */
+static inline void
+pipeline_release(struct pipeline_worker *w, struct pipeline_item *it)
+{
+    wait_while(&w->wait, pipeline_ring_enq(it->home, it) != RINGBUF_OK);
+}
+
+/* passes the item through the stages fused after the worker's and on to the
+ * next step, or back to its pool after the last step.  A first step of one
+ * instance numbers the items, that of a wide one counts them. */
+static inline void
+pipeline_pass(struct pipeline_worker *w, struct pipeline_item *it)
+{
+    struct pipeline *p = w->p;
+
+    if (w->step == 0 && !it->eof) {
+        if (pipeline_wide(p, 0))
+            vatomic32_inc_rlx(&p->produced);
+        else
+            it->seq = w->seq++;
+    }
+    pipeline_apply(w, 1, it);
+    if (w->step == p->nsteps - 1)
+        pipeline_release(w, it);
+    else
+        pipeline_put(w, it);
+}
+
+/* ends the stream of an instance of the first step, with an item taken from
+ * its pool: the last instance to end passes it on as the marker, numbered
+ * after all items, the others keep theirs since only the last step puts
+ * items in the pools */
+static inline void
+pipeline_end(struct pipeline_worker *w, struct pipeline_item *it)
+{
+    struct pipeline *p = w->p;
+
+    if (vatomic32_dec_get(&p->sources) != 0)
+        return;
+    it->eof = true;
+    it->seq = pipeline_wide(p, 0) ? vatomic32_read(&p->produced) : w->seq;
+    pipeline_pass(w, it);
+}
+
+/* runs an instance of the first step */
+static inline void
+pipeline_source(struct pipeline_worker *w)
+{
+    struct stage *st = pipeline_head(w->p, 0);
+    struct pipeline_item *it;
+
+    for (;;) {
+        wait_while(&w->wait, !pipeline_new(w, &it));
+        it->seq = w->seq;
+        if (!st->fn(st->arg, w->instance, it))
+            break;
+        pipeline_pass(w, it);
+    }
+    pipeline_end(w, it);
+}
+
+/* runs an instance of the other steps */
+static inline void
+pipeline_stage(struct pipeline_worker *w)
+{
+    struct stage *st = pipeline_head(w->p, w->step);
+    struct pipeline_item *it;
+
+    while (pipeline_take(w, &it)) {
+        bool stop;
+
+        if (st->fn != NULL)
+            st->fn(st->arg, w->instance, it);
+        stop = pipeline_stops(w, it);
+        pipeline_pass(w, it);
+        if (stop)
+            return;
+    }
+}
+
+static inline void *
+pipeline_thread(void *arg)
+{
+    struct pipeline_worker *w = (struct pipeline_worker *)arg;
+    struct pipeline *p = w->p;
+    struct stage *st = pipeline_head(p, w->step);
+
+    wait_init(&w->wait, st->wait);
+    wait_track(&w->wait, st->name, w->instance);
+    if (w->cpu >= 0)
+        placement_pin(&p->placement, w->cpu);
+    if (st->run != NULL)
+        st->run(w);
+    else if (w->step == 0)
+        pipeline_source(w);
+    else
+        pipeline_stage(w);
+    if (w->step == p->nsteps - 1)
+        vatomic32_write_rel(&p->finished, 1);
+    wait_untrack(&w->wait);
+    return 0;
+}
+
+/* runs the pipeline until the last stage gets the end of stream marker */
+static inline void
+pipeline_run(struct pipeline *p)
+{
+    for (unsigned int i = 0; i < p->nworkers; i++)
+        pthread_create(&p->workers[i].thread, 0, pipeline_thread,
+                       &p->workers[i]);
+    for (unsigned int i = 0; i < p->nworkers; i++)
+        pthread_join(p->workers[i].thread, 0);
+}
+
+/* frees the rings and the items, the pipeline can then be built again */
+static inline void
+pipeline_fini(struct pipeline *p)
+{
+    for (unsigned int s = 0; s + 1 < p->nsteps; s++)
+        free(p->links[s].lanes);
+    arena_fini(&p->items);
+    arena_fini(&p->rings);
+    free(p->pools);
+    free(p->links);
+    free(p->steps);
+    free(p->workers);
+    if (p->pin)
+        placement_fini(&p->placement);
+}
+
+#endif
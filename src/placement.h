@@ -0,0 +1,371 @@
+/*
+ * Copyright (C) Huawei Technologies Co., Ltd. 2026. All rights reserved.
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+/*******************************************************************************
+ * Thread placement from the cpu topology in /sys/devices/system/cpu.
+ *
+ * The threads of a pipeline are placed one after the other, each on the free
+ * cpu closest to the one of the thread it talks to.  Closeness is the cache
+ * level the two cpus share: another core with the same L2 comes first, then
+ * another core with the same last level cache, then an SMT sibling, which
+ * shares every cache but also the execution units of the core, then a cpu of
+ * the same NUMA node, and last any cpu.  A cpu of a core that already has a
+ * thread counts as an SMT sibling.  Once every cpu has a thread, the placement
+ * starts over.
+ *
+ * The candidate cpus are those the process may run on, minus the isolated ones
+ * (isolcpus=), or with PLACE_ISOLATED only the isolated ones, so that a
+ * latency-critical run does not share its cpus with the rest of the system.
+ * PLACE_FIFO runs the placed threads with the SCHED_FIFO real-time policy,
+ * except those that share their cpu once the placement started over: a FIFO
+ * thread that waits for another on its own cpu would keep it from running.
+ * Without the topology, as outside Linux, all cpus are equally close.
+ ******************************************************************************/
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <dirent.h>
+#endif
+
+#define PLACE_ISOLATED 1 /* only the isolated cpus */
+#define PLACE_FIFO 2     /* SCHED_FIFO for the placed threads */
+
+#define PLACE_SYSFS "/sys/devices/system/cpu"
+
+/* a core, an L2 and a last level cache are named after their lowest cpu */
+struct place_cpu {
+    int cpu;
+    int core;
+    int l2;
+    int llc;
+    int node;
+    bool used;            /* a thread is placed on it in this round */
+    unsigned int threads; /* threads placed on it in all rounds */
+};
+
+struct placement {
+    struct place_cpu *cpus;
+    unsigned int n;
+    unsigned int nused;
+    int flags;
+};
+
+#ifdef __linux__
+/* reads a cpu list such as 0-3,8-11 into set, returns false without the file */
+static inline bool
+place_read_list(const char *path, cpu_set_t *set)
+{
+    FILE *fp = fopen(path, "r");
+    int lo, hi;
+
+    CPU_ZERO(set);
+    if (fp == NULL)
+        return false;
+    while (fscanf(fp, "%d", &lo) == 1) {
+        hi = lo;
+        if (fscanf(fp, "-%d", &hi) != 1)
+            hi = lo;
+        for (int c = lo; c <= hi && c < CPU_SETSIZE; c++)
+            CPU_SET(c, set);
+        if (fgetc(fp) != ',')
+            break;
+    }
+    fclose(fp);
+    return true;
+}
+
+/* returns the lowest cpu of the list in path, or fallback */
+static inline int
+place_read_first(const char *path, int fallback)
+{
+    cpu_set_t set;
+
+    if (!place_read_list(path, &set))
+        return fallback;
+    for (int c = 0; c < CPU_SETSIZE; c++)
+        if (CPU_ISSET(c, &set))
+            return c;
+    return fallback;
+}
+
+/* reads the core, caches and node of cpu c */
+static inline void
+place_cpu_init(struct place_cpu *p, int c)
+{
+    char path[128];
+    struct dirent *e;
+    DIR *dir;
+    int level;
+
+    p->cpu = c;
+    snprintf(path, sizeof(path),
+             PLACE_SYSFS "/cpu%d/topology/thread_siblings_list", c);
+    p->core = place_read_first(path, c);
+    p->l2 = p->llc = p->core;
+    for (int i = 0;; i++) {
+        FILE *fp;
+        char type[32] = "";
+
+        snprintf(path, sizeof(path), PLACE_SYSFS "/cpu%d/cache/index%d/level",
+                 c, i);
+        if ((fp = fopen(path, "r")) == NULL)
+            break;
+        if (fscanf(fp, "%d", &level) != 1)
+            level = 0;
+        fclose(fp);
+        snprintf(path, sizeof(path), PLACE_SYSFS "/cpu%d/cache/index%d/type",
+                 c, i);
+        if ((fp = fopen(path, "r")) != NULL) {
+            if (fscanf(fp, "%31s", type) != 1)
+                type[0] = '\0';
+            fclose(fp);
+        }
+        if (level < 2 || strcmp(type, "Instruction") == 0)
+            continue;
+        snprintf(path, sizeof(path),
+                 PLACE_SYSFS "/cpu%d/cache/index%d/shared_cpu_list", c, i);
+        if (level == 2)
+            p->l2 = place_read_first(path, p->l2);
+        p->llc = place_read_first(path, p->llc);
+    }
+
+    p->node = 0;
+    snprintf(path, sizeof(path), PLACE_SYSFS "/cpu%d", c);
+    if ((dir = opendir(path)) == NULL)
+        return;
+    while ((e = readdir(dir)) != NULL)
+        if (sscanf(e->d_name, "node%d", &p->node) == 1)
+            break;
+    closedir(dir);
+}
+#endif
+
+/* finds the candidate cpus and reads their topology */
+static inline void
+placement_init(struct placement *pl, int flags)
+{
+    pl->flags = flags;
+    pl->n = pl->nused = 0;
+#ifdef __linux__
+    cpu_set_t allowed, isolated;
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        perror("could not get affinity");
+        exit(EXIT_FAILURE);
+    }
+    place_read_list(PLACE_SYSFS "/isolated", &isolated);
+    if (flags & PLACE_ISOLATED)
+        allowed = isolated;
+    else
+        for (int c = 0; c < CPU_SETSIZE; c++)
+            if (CPU_ISSET(c, &isolated))
+                CPU_CLR(c, &allowed);
+    if (CPU_COUNT(&allowed) == 0) {
+        fprintf(stderr, "no %scpu to place threads on\n",
+                flags & PLACE_ISOLATED ? "isolated " : "");
+        exit(EXIT_FAILURE);
+    }
+    pl->cpus = calloc((size_t)CPU_COUNT(&allowed), sizeof(struct place_cpu));
+    if (pl->cpus == NULL) {
+        perror("placement malloc");
+        exit(EXIT_FAILURE);
+    }
+    for (int c = 0; c < CPU_SETSIZE; c++)
+        if (CPU_ISSET(c, &allowed))
+            place_cpu_init(&pl->cpus[pl->n++], c);
+#else
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (ncpus < 1)
+        ncpus = 1;
+    pl->cpus = calloc((size_t)ncpus, sizeof(struct place_cpu));
+    if (pl->cpus == NULL) {
+        perror("placement malloc");
+        exit(EXIT_FAILURE);
+    }
+    for (int c = 0; c < ncpus; c++)
+        pl->cpus[pl->n++] = (struct place_cpu){c, c, c, c, 0, false};
+#endif
+
+    /* check once that the real-time policy is allowed, rather than in every
+     * thread */
+    if (flags & PLACE_FIFO) {
+        struct sched_param sp, old;
+        int policy, err;
+
+        sp.sched_priority = sched_get_priority_min(SCHED_FIFO);
+        pthread_getschedparam(pthread_self(), &policy, &old);
+        err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp);
+        if (err != 0) {
+            fprintf(stderr, "could not use SCHED_FIFO: %s\n", strerror(err));
+            pl->flags &= ~PLACE_FIFO;
+        } else {
+            pthread_setschedparam(pthread_self(), policy, &old);
+        }
+    }
+}
+
+/* returns the NUMA node of cpu, or -1 if it is not a candidate */
+static inline int
+placement_node(const struct placement *pl, int cpu)
+{
+    for (unsigned int i = 0; i < pl->n; i++)
+        if (pl->cpus[i].cpu == cpu)
+            return pl->cpus[i].node;
+    return -1;
+}
+
+/* returns true if a thread is placed on the core of c */
+static inline bool
+place_core_busy(const struct placement *pl, const struct place_cpu *c)
+{
+    for (unsigned int i = 0; i < pl->n; i++)
+        if (pl->cpus[i].used && pl->cpus[i].core == c->core)
+            return true;
+    return false;
+}
+
+/* the lower, the closer to from, see above */
+static inline int
+place_cost(const struct placement *pl, const struct place_cpu *from,
+           const struct place_cpu *c)
+{
+    int cost = 5;
+
+    if (from == NULL)
+        cost = 0;
+    else if (from->core == c->core)
+        cost = 3;
+    else if (from->l2 == c->l2)
+        cost = 1;
+    else if (from->llc == c->llc)
+        cost = 2;
+    else if (from->node == c->node)
+        cost = 4;
+    if (cost < 3 && place_core_busy(pl, c))
+        cost = 3;
+    return cost;
+}
+
+/* returns the free cpu closest to cpu near, or the first free cpu if near is
+ * -1, and takes it */
+static inline int
+placement_next(struct placement *pl, int near)
+{
+    struct place_cpu *from = NULL, *best = NULL;
+    int best_cost = 0;
+
+    if (pl->nused == pl->n) {
+        for (unsigned int i = 0; i < pl->n; i++)
+            pl->cpus[i].used = false;
+        pl->nused = 0;
+    }
+    for (unsigned int i = 0; i < pl->n; i++)
+        if (pl->cpus[i].cpu == near)
+            from = &pl->cpus[i];
+    for (unsigned int i = 0; i < pl->n; i++) {
+        struct place_cpu *c = &pl->cpus[i];
+        int cost;
+
+        if (c->used)
+            continue;
+        cost = place_cost(pl, from, c);
+        if (best == NULL || cost < best_cost) {
+            best = c;
+            best_cost = cost;
+        }
+    }
+    best->used = true;
+    best->threads++;
+    pl->nused++;
+    return best->cpu;
+}
+
+/* returns a free cpu on another node than cpu near and takes it, or returns -1
+ * if there is none, to measure the cost of crossing nodes */
+static inline int
+placement_far(struct placement *pl, int near)
+{
+    int node = placement_node(pl, near);
+
+    for (unsigned int i = 0; i < pl->n; i++) {
+        struct place_cpu *c = &pl->cpus[i];
+
+        if (!c->used && c->node != node) {
+            c->used = true;
+            c->threads++;
+            pl->nused++;
+            return c->cpu;
+        }
+    }
+    return -1;
+}
+
+/* returns true if cpu has at most one placed thread */
+static inline bool
+placement_alone(const struct placement *pl, int cpu)
+{
+    for (unsigned int i = 0; i < pl->n; i++)
+        if (pl->cpus[i].cpu == cpu)
+            return pl->cpus[i].threads <= 1;
+    return true;
+}
+
+/* runs the calling thread on cpu only, with the real-time policy if asked and
+ * if the thread has the cpu to itself */
+static inline void
+placement_pin(const struct placement *pl, int cpu)
+{
+#if !defined(SET_CPU_AFFINITY)
+    (void)cpu;
+#elif defined(__linux__)
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) < 0) {
+        perror("failed to set affinity");
+        exit(EXIT_FAILURE);
+    }
+#else
+    cpuset_t *cset = cpuset_create();
+
+    if (cset == NULL) {
+        perror("cpuset_create");
+        exit(EXIT_FAILURE);
+    }
+    cpuset_set((cpuid_t)cpu, cset);
+    if (pthread_setaffinity_np(pthread_self(), cpuset_size(cset), cset) != 0) {
+        perror("setaffinity");
+        exit(EXIT_FAILURE);
+    }
+    cpuset_destroy(cset);
+#endif
+    if ((pl->flags & PLACE_FIFO) && placement_alone(pl, cpu)) {
+        struct sched_param sp;
+
+        sp.sched_priority = sched_get_priority_min(SCHED_FIFO);
+        pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp);
+    }
+}
+
+static inline void
+placement_fini(struct placement *pl)
+{
+    free(pl->cpus);
+    pl->cpus = NULL;
+    pl->n = pl->nused = 0;
+}
+
+#endif
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) Huawei Technologies Co., Ltd. 2026. All rights reserved.
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef REORDER_H
+#define REORDER_H
+/*******************************************************************************
+ * Bounded reorder buffer: many producers put items tagged with a sequence
+ * number in any order, a single consumer gets them back in sequence order.
+ *
+ * The buffer only holds items whose sequence number lies within `size` of the
+ * next number to be consumed.  Producers must wait for reorder_admit() before
+ * producing an item, so a stalled producer throttles the others instead of
+ * making the buffer grow.  The size must be a power of two so that the slot
+ * index survives the wrap-around of the sequence numbers.
+ ******************************************************************************/
+#include <assert.h>
+#include <stdbool.h>
+#include <vsync/atomic.h>
+
+#include "ringbuf.h"
+
+typedef struct {
+    vatomicptr_t *slot;
+    vatomic32_t next;
+    unsigned int size;
+} reorder_t;
+
+static inline void
+reorder_init(reorder_t *q, vatomicptr_t *b, unsigned int s)
+{
+    assert(s > 0 && (s & (s - 1)) == 0);
+    q->slot = b;
+    q->size = s;
+    for (unsigned int i = 0; i < s; i++)
+        vatomicptr_init(&q->slot[i], 0);
+    vatomic32_init(&q->next, 0);
+}
+
+/* returns true if an item with sequence number seq fits in the buffer */
+static inline bool
+reorder_admit(reorder_t *q, unsigned int seq)
+{
+    return seq - vatomic32_read_acq(&q->next) < q->size;
+}
+
+/* puts an admitted item, never blocks */
+static inline void
+reorder_put(reorder_t *q, unsigned int seq, void *v)
+{
+    vatomicptr_write_rel(&q->slot[seq % q->size], v);
+}
+
+static inline int
+reorder_get(reorder_t *q, void **v)
+{
+    unsigned int next = vatomic32_read_rlx(&q->next);
+    vatomicptr_t *slot = &q->slot[next % q->size];
+    void *p = vatomicptr_read_acq(slot);
+
+    if (p == 0)
+        return RINGBUF_EMPTY;
+
+    /* clear the slot before it is handed to the producer of next + size */
+    vatomicptr_write_rlx(slot, 0);
+    vatomic32_write_rel(&q->next, next + 1);
+    *v = p;
+
+    return RINGBUF_OK;
+}
+#endif
@@ -0,0 +1,391 @@
+/*
+ * Copyright (C) Huawei Technologies Co., Ltd. 2026. All rights reserved.
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef STATS_H
+#define STATS_H
+/*******************************************************************************
+ * Live statistics of the rings and the stages, built with -DSTATS.
+ *
+ * - Every ring counts its enqueues and dequeues, the failed ones that found it
+ *   full or empty, and how full it is over time as a log2 histogram.  Rings
+ *   are found by address in a table, through a small per-thread cache so
+ *   that a thread polling a ring looks it up once, and the header redefines
+ *   ringbuf_enq() and ringbuf_deq() to count, so it must come after the ring
+ *   variant.  Once the table is full, the failed operations of the rings
+ *   left out are only counted in total.
+ * - Every stage thread counts the time it spends waiting for a ring, its
+ *   waits and its polls, see wait.h, and is busy the rest of the time.
+ *
+ * The successful operations are not counted where they happen: the head and
+ * tail of a ring already count them, so the fast path only pays a branch.  A
+ * failed operation is about to wait anyway and updates its counter, which has
+ * a single writer, the producer or the consumer side of the ring or the stage
+ * thread, so it is updated with a plain load and store and the sides are on
+ * separate cache lines.  Only registering a ring or a stage takes an atomic
+ * read-modify-write and stats_lock, which the sampler holds.
+ *
+ * stats_start() starts a thread that samples the head and tail of every ring
+ * each STATS_TICK_NS into the 64-bit counts and the histogram, and that
+ * prints the statistics on SIGUSR1.  stats_dump() prints them at any time.
+ *
+ * Without -DSTATS, every call compiles to nothing.
+ ******************************************************************************/
+#ifdef STATS
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <vsync/atomic.h>
+
+#include "now.h"
+#include "ringbuf.h"
+
+#define STATS_RINGS 8192 /* a power of two */
+#define STATS_STAGES 256
+#define STATS_BUCKETS 12 /* occupancy 0, 1, 2-3, 4-7, ..., 1024 and more */
+#define STATS_TICK_NS 1000000
+#define STATS_CACHE 16 /* rings per thread, a power of two */
+
+/* reads the head or the tail of a ring, plain or atomic as the variant has */
+#define stats_index(x)                                                         \
+    _Generic((x),                                                              \
+        vatomic32_t: vatomic32_read_rlx((vatomic32_t *)&(x)),                  \
+        default: *(volatile unsigned int *)&(x))
+
+struct stats_ring {
+    vatomicptr_t key; /* the ring, NULL if the entry is free */
+    char name[24];
+
+    /* written by the sampler, under stats_lock */
+    uint64_t enq, deq;
+    unsigned int tail, head; /* as last sampled */
+    uint64_t hist[STATS_BUCKETS];
+
+    vatomic64_t full __attribute__((aligned(64)));  /* by the producer */
+    vatomic64_t empty __attribute__((aligned(64))); /* by the consumer */
+};
+
+struct stats_stage {
+    char name[24];
+    nanosec_t start;
+    vatomic64_t end;     /* 0 while the thread runs */
+    vatomic64_t waiting; /* start of the current wait, 0 if none */
+    vatomic64_t wait_ns;
+    vatomic64_t waits;
+    vatomic64_t polls;
+} __attribute__((aligned(64)));
+
+static struct stats_ring stats_rings[STATS_RINGS];
+static struct stats_ring *stats_order[STATS_RINGS]; /* in registration order */
+static vatomic32_t stats_nrings;
+static struct stats_stage stats_stages[STATS_STAGES];
+static vatomic32_t stats_nstages;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static vatomic64_t stats_untracked; /* failed operations of rings left out */
+static vatomic32_t stats_gen;       /* bumped by stats_reset() */
+
+/* the entries of the rings a thread used last, valid for generation gen */
+struct stats_cached {
+    ringbuf_t *q;
+    struct stats_ring *s; /* NULL if the table had no room for q */
+    unsigned int gen;
+};
+static __thread struct stats_cached stats_cache[STATS_CACHE];
+
+/* adds n to a counter of the calling thread */
+static inline void
+stats_add(vatomic64_t *c, uint64_t n)
+{
+    vatomic64_write_rlx(c, vatomic64_read_rlx(c) + n);
+}
+
+static inline unsigned int
+stats_hash(ringbuf_t *q)
+{
+    return (unsigned int)((((uintptr_t)q >> 4) * 0x9e3779b97f4a7c15ULL) >> 32);
+}
+
+/* returns the entry of ring q, registering it on first use, or NULL if the
+ * table is full */
+static inline struct stats_ring *
+stats_ring(ringbuf_t *q)
+{
+    unsigned int h = stats_hash(q);
+
+    for (unsigned int i = h; i - h < STATS_RINGS; i++) {
+        struct stats_ring *s = &stats_rings[i % STATS_RINGS];
+        void *key = vatomicptr_read_acq(&s->key);
+
+        if (key == NULL) {
+            key = vatomicptr_cmpxchg(&s->key, NULL, q);
+            if (key == NULL) {
+                pthread_mutex_lock(&stats_lock);
+                unsigned int k = vatomic32_get_inc(&stats_nrings);
+                s->tail = stats_index(q->tail);
+                s->head = stats_index(q->head);
+                if (k < STATS_RINGS)
+                    stats_order[k] = s;
+                pthread_mutex_unlock(&stats_lock);
+                return s;
+            }
+        }
+        if (key == q)
+            return s;
+    }
+    return NULL;
+}
+
+/* returns the entry of ring q from the cache of the calling thread */
+static inline struct stats_ring *
+stats_ring_cached(ringbuf_t *q)
+{
+    struct stats_cached *c = &stats_cache[stats_hash(q) % STATS_CACHE];
+    unsigned int gen = vatomic32_read_rlx(&stats_gen);
+
+    if (c->q != q || c->gen != gen)
+        *c = (struct stats_cached){q, stats_ring(q), gen};
+    return c->s;
+}
+
+/* names ring q in the summary */
+static inline void
+stats_ring_name(ringbuf_t *q, const char *fmt, ...)
+{
+    struct stats_ring *s = stats_ring(q);
+    va_list ap;
+
+    if (s == NULL)
+        return;
+    va_start(ap, fmt);
+    vsnprintf(s->name, sizeof(s->name), fmt, ap);
+    va_end(ap);
+}
+
+/* counts a failed operation, the ring is full or empty */
+static inline void
+stats_fail(ringbuf_t *q, int r)
+{
+    struct stats_ring *s = stats_ring_cached(q);
+
+    if (s == NULL)
+        vatomic64_inc_rlx(&stats_untracked);
+    else
+        stats_add(r == RINGBUF_FULL ? &s->full : &s->empty, 1);
+}
+
+/* the operations as macros, so that even an -O0 build only adds a branch */
+#define ringbuf_enq(q, v) stats_op((ringbuf_enq)(q, v), q)
+#define ringbuf_deq(q, v) stats_op((ringbuf_deq)(q, v), q)
+#define stats_op(op, q)                                                        \
+    ({                                                                         \
+        int stats_r = (op);                                                    \
+        if (__builtin_expect(stats_r != RINGBUF_OK, 0))                        \
+            stats_fail(q, stats_r);                                            \
+        stats_r;                                                               \
+    })
+
+/* registers a stage thread, named name and id */
+static inline struct stats_stage *
+stats_stage_new(const char *name, unsigned int id)
+{
+    unsigned int k = vatomic32_get_inc(&stats_nstages);
+    struct stats_stage *s;
+
+    if (k >= STATS_STAGES)
+        return NULL;
+    s = &stats_stages[k];
+    snprintf(s->name, sizeof(s->name), "%s %u", name, id);
+    vatomic64_write_rlx(&s->end, 0);
+    vatomic64_write_rlx(&s->waiting, 0);
+    vatomic64_write_rlx(&s->wait_ns, 0);
+    vatomic64_write_rlx(&s->waits, 0);
+    vatomic64_write_rlx(&s->polls, 0);
+    s->start = now();
+    return s;
+}
+
+static inline void
+stats_stage_end(struct stats_stage *s)
+{
+    if (s != NULL)
+        vatomic64_write_rlx(&s->end, now());
+}
+
+/* a wait of the stage starts */
+static inline void
+stats_wait_begin(struct stats_stage *s)
+{
+    if (s != NULL)
+        vatomic64_write_rlx(&s->waiting, now());
+}
+
+/* the current wait of the stage ends after polls polls */
+static inline void
+stats_wait_end(struct stats_stage *s, unsigned int polls)
+{
+    if (s == NULL)
+        return;
+    stats_add(&s->wait_ns, now() - vatomic64_read_rlx(&s->waiting));
+    vatomic64_write_rlx(&s->waiting, 0);
+    stats_add(&s->waits, 1);
+    stats_add(&s->polls, polls);
+}
+
+/* adds the operations since the last sample to the counts of every ring, and
+ * its occupancy to the histogram if hist is true, under stats_lock */
+static inline void
+stats_sample(bool hist)
+{
+    unsigned int nrings = vatomic32_read(&stats_nrings);
+
+    if (nrings > STATS_RINGS)
+        nrings = STATS_RINGS;
+    for (unsigned int i = 0; i < nrings; i++) {
+        struct stats_ring *s = stats_order[i];
+        ringbuf_t *q;
+
+        if (s == NULL || (q = vatomicptr_read_acq(&s->key)) == NULL)
+            continue;
+        /* the head first, so that the tail is not behind it */
+        unsigned int head = stats_index(q->head);
+        unsigned int tail = stats_index(q->tail);
+        unsigned int occ = tail - head;
+
+        s->deq += head - s->head;
+        s->enq += tail - s->tail;
+        s->head = head;
+        s->tail = tail;
+        if (hist) {
+            unsigned int b = occ ? 32 - (unsigned int)__builtin_clz(occ) : 0;
+            s->hist[b < STATS_BUCKETS ? b : STATS_BUCKETS - 1]++;
+        }
+    }
+}
+
+static inline void
+stats_dump(FILE *fp)
+{
+    unsigned int nrings = vatomic32_read(&stats_nrings);
+    unsigned int nstages = vatomic32_read(&stats_nstages);
+    nanosec_t t = now();
+
+    pthread_mutex_lock(&stats_lock);
+    stats_sample(false);
+    if (nrings > STATS_RINGS)
+        nrings = STATS_RINGS;
+    if (nstages > STATS_STAGES)
+        nstages = STATS_STAGES;
+    fprintf(fp, "%-16s %12s %12s %12s %12s  %s\n", "ring", "enq", "full",
+            "deq", "empty", "occupancy: % of the time");
+    for (unsigned int i = 0; i < nrings; i++) {
+        struct stats_ring *s = stats_order[i];
+        uint64_t samples = 0;
+
+        /* skip the rings that the run did not use */
+        if (s == NULL || (s->enq == 0 && vatomic64_read_rlx(&s->empty) == 0))
+            continue;
+        for (unsigned int b = 0; b < STATS_BUCKETS; b++)
+            samples += s->hist[b];
+        fprintf(fp, "%-16s %12lu %12lu %12lu %12lu ",
+                s->name[0] ? s->name : "-", (unsigned long)s->enq,
+                (unsigned long)vatomic64_read_rlx(&s->full),
+                (unsigned long)s->deq,
+                (unsigned long)vatomic64_read_rlx(&s->empty));
+        for (unsigned int b = 0; samples > 0 && b < STATS_BUCKETS; b++)
+            if (s->hist[b] > 0)
+                fprintf(fp, " %u:%.1f", b == 0 ? 0 : 1U << (b - 1),
+                        100.0 * (double)s->hist[b] / (double)samples);
+        fprintf(fp, "\n");
+    }
+    if (vatomic64_read_rlx(&stats_untracked) > 0)
+        fprintf(fp, "%lu failed operations on rings left out of the table\n",
+                (unsigned long)vatomic64_read_rlx(&stats_untracked));
+    pthread_mutex_unlock(&stats_lock);
+
+    if (nstages > 0)
+        fprintf(fp, "%-16s %12s %12s %12s %12s\n", "stage", "busy s",
+                "wait s", "waits", "polls");
+    for (unsigned int i = 0; i < nstages; i++) {
+        struct stats_stage *s = &stats_stages[i];
+        nanosec_t end = vatomic64_read_rlx(&s->end);
+        nanosec_t since = vatomic64_read_rlx(&s->waiting);
+        nanosec_t wait = vatomic64_read_rlx(&s->wait_ns);
+        nanosec_t run = (end != 0 ? end : t) - s->start;
+
+        /* a thread stuck in a wait shows as waiting */
+        if (since != 0 && end == 0 && t > since)
+            wait += t - since;
+        fprintf(fp, "%-16s %12.3f %12.3f %12lu %12lu\n", s->name,
+                in_sec(run > wait ? run - wait : 0), in_sec(wait),
+                (unsigned long)vatomic64_read_rlx(&s->waits),
+                (unsigned long)vatomic64_read_rlx(&s->polls));
+    }
+}
+
+/* forgets the rings and the stages, for a new run or before the rings are
+ * freed */
+static inline void
+stats_reset(void)
+{
+    pthread_mutex_lock(&stats_lock);
+    vatomic32_write(&stats_nrings, 0);
+    vatomic32_write(&stats_nstages, 0);
+    vatomic64_write(&stats_untracked, 0);
+    vatomic32_inc(&stats_gen);
+    memset(stats_order, 0, sizeof(stats_order));
+    memset(stats_rings, 0, sizeof(stats_rings));
+    pthread_mutex_unlock(&stats_lock);
+}
+
+static inline void *
+stats_thread(void *arg)
+{
+    sigset_t *set = (sigset_t *)arg;
+    struct timespec tick = {0, STATS_TICK_NS};
+
+    for (;;) {
+        if (sigtimedwait(set, NULL, &tick) == SIGUSR1) {
+            stats_dump(stderr);
+            continue;
+        }
+        pthread_mutex_lock(&stats_lock);
+        stats_sample(true);
+        pthread_mutex_unlock(&stats_lock);
+    }
+    return 0;
+}
+
+/* blocks SIGUSR1 in the calling thread and the threads it creates, and
+ * starts the thread that samples the rings and prints the statistics */
+static inline void
+stats_start(void)
+{
+    static sigset_t set;
+    pthread_t t;
+
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+    pthread_create(&t, 0, stats_thread, &set);
+    pthread_detach(t);
+}
+
+#else /* !STATS */
+
+#define stats_ring_name(...) ((void)0)
+#define stats_stage_new(name, id) NULL
+#define stats_stage_end(s) ((void)0)
+#define stats_wait_begin(s) ((void)0)
+#define stats_wait_end(s, polls) ((void)0)
+#define stats_dump(fp) ((void)0)
+#define stats_reset() ((void)0)
+#define stats_start() ((void)0)
+#define stats_op(op, q) (op)
+
+#endif
+#endif
@@ -0,0 +1,242 @@
+/*
+ * Copyright (C) Huawei Technologies Co., Ltd. 2026. All rights reserved.
+ * SPDX-License-Identifier: MIT
+ */
+/*******************************************************************************
+ * Stress harness: runs the ccat pipeline over and over in the same process,
+ * with random file sizes, chunk sizes, ring lengths and numbers of readers
+ * and mediators, and checks every output against the input with CRC32C.
+ *
+ * The ring buffer variant is chosen at compile time with -DRINGBUF, see the
+ * stress targets of the Makefile.  Each run derives all its parameters from
+ * its seed, so that a failure can be replayed with `-s seed -n 1`.
+ ******************************************************************************/
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef RINGBUF
+#define RINGBUF "ringbuf.h"
+#endif
+#include RINGBUF
+
+#define CCAT_NO_MAIN
+#include "ccat.c"
+
+#define MAX_FILE_SIZE (256 * 1024)
+
+static char in_path[] = "/tmp/stress-in-XXXXXX";
+static unsigned long long run_seed;
+static bool running;
+static unsigned int timeout = 60; /* seconds per run, see run_timeout() */
+static char alarm_msg[128];       /* what on_alarm() says, set per run */
+static size_t alarm_len;
+
+/* xorshift64*, good enough to make up data and parameters */
+static uint64_t
+rnd(uint64_t *s)
+{
+    *s ^= *s >> 12;
+    *s ^= *s << 25;
+    *s ^= *s >> 27;
+    return *s * 0x2545f4914f6cdd1dULL;
+}
+
+static void
+report(const char *what)
+{
+    fprintf(stderr, "%s: seed %llu, ring variant %s\n", what, run_seed,
+            RINGBUF);
+}
+
+/* a run that does not finish is most likely a lost wake-up or a lost chunk.
+ * Only async-signal-safe calls here: the message is formatted before the run,
+ * and flight_dump() only uses write(). */
+static void
+on_alarm(int sig)
+{
+    ssize_t r = write(STDERR_FILENO, alarm_msg, alarm_len);
+
+    (void)r;
+    flight_dump("timeout");
+    unlink(in_path);
+    _exit(2);
+}
+
+/* ccat exits on fatal errors, say which run did it */
+static void
+on_exit_report(void)
+{
+    if (running)
+        report("exited during run");
+    unlink(in_path);
+}
+
+/* the timeout of a run of threads over ncpus cpus: each thread that busy
+ * waits gets a time slice in turn when they outnumber the cpus, so the run
+ * may take that many times as long */
+static unsigned int
+run_timeout(unsigned int threads, long ncpus)
+{
+    unsigned int n = ncpus > 0 ? (unsigned int)ncpus : 1;
+
+    if (threads <= n)
+        return timeout;
+    return timeout * ((threads + n - 1) / n);
+}
+
+static void
+stress_usage(const char *prog)
+{
+    printf("usage: %s [-n iterations] [-s seed] [-t timeout]\n", prog);
+    exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+    unsigned long long seed = (unsigned long long)time(NULL);
+    unsigned long iterations = 1000000;
+    char out_path[] = "/tmp/stress-out-XXXXXX";
+    char *data = malloc(MAX_FILE_SIZE);
+    char *back = malloc(MAX_FILE_SIZE + 1);
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:s:t:")) != -1) {
+        switch (opt) {
+        case 'n':
+            iterations = strtoul(optarg, NULL, 0);
+            break;
+        case 's':
+            seed = strtoull(optarg, NULL, 0);
+            break;
+        case 't':
+            timeout = (unsigned int)atoi(optarg);
+            break;
+        default:
+            stress_usage(argv[0]);
+        }
+    }
+
+    int in = mkstemp(in_path);
+    int out = mkstemp(out_path);
+    if (!data || !back || in < 0 || out < 0) {
+        perror("could not set up stress harness");
+        return 1;
+    }
+    unlink(out_path);
+
+    /* the pipeline writes to stdout */
+    fflush(stdout);
+    if (dup2(out, STDOUT_FILENO) < 0) {
+        perror("dup2");
+        return 1;
+    }
+    signal(SIGALRM, on_alarm);
+    atexit(on_exit_report);
+    crc32c_init(true);
+
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    fprintf(stderr, "ring variant %s, seed %llu, %lu iterations\n", RINGBUF,
+            seed, iterations);
+    for (unsigned long i = 0; i < iterations; i++) {
+        uint64_t s;
+        char args[2][16], waits[64];
+        char *cargv[] = {"ccat", "-j", args[0], "-m", args[1],
+                         "-W", waits, in_path, 0, 0};
+        int cargc = 8;
+
+        run_seed = seed + i;
+        s = run_seed * 0x9e3779b97f4a7c15ULL | 1;
+
+        /* mostly small files, sometimes empty or large */
+        size_t size = (size_t)(rnd(&s) % ((size_t)1 << (rnd(&s) % 19)));
+        for (size_t k = 0; k < size; k++)
+            data[k] = (char)rnd(&s);
+
+        /* parallel readers need chunks that divide the blocks */
+        unsigned int readers = 1 + (unsigned int)(rnd(&s) % 4);
+        unsigned int mediators = 1 + (unsigned int)(rnd(&s) % 4);
+
+        /* half of the runs keep the mediators that fusion would remove */
+        bool unfused = rnd(&s) % 2;
+        if (readers > 1)
+            chunk_size = 1U << (rnd(&s) % 9);
+        else
+            chunk_size = 1 + (unsigned int)(rnd(&s) % CHUNK_SIZE);
+        /* ring lengths are powers of two, in the ranges of -T, as ccat
+         * only runs with those */
+        free_len = 32U << (rnd(&s) % 6);
+        rbuf_len = 8U << (rnd(&s) % 6);
+        reorder_len = 1U << (rnd(&s) % 11);
+        snprintf(args[0], sizeof(args[0]), "%u", readers);
+        snprintf(args[1], sizeof(args[1]), "%u", mediators);
+
+        /* every stage waits in its own way, ccat_main parses the list in
+         * place.  With more threads (opener, readers, mediators, writer)
+         * than cpus, a spinning thread keeps the one it waits for off its
+         * cpu for a whole time slice, so only the policies that let go of
+         * the cpu are drawn, backoff only relaxes longer. */
+        unsigned int threads = 2 + readers + (unfused ? mediators : 0);
+        bool crowded = ncpus > 0 && threads > (unsigned int)ncpus;
+        const char *w[3];
+        for (int k = 0; k < 3; k++) {
+            enum wait_policy policy;
+            do
+                policy = (enum wait_policy)(rnd(&s) % WAIT_POLICIES);
+            while (crowded && !wait_yields(policy));
+            w[k] = wait_names[policy];
+        }
+        snprintf(waits, sizeof(waits), "reader=%s,mediator=%s,writer=%s",
+                 w[0], w[1], w[2]);
+        char policies[64];
+        strcpy(policies, waits);
+
+        if (unfused) {
+            cargv[cargc - 1] = "-F";
+            cargv[cargc++] = in_path;
+        }
+
+        if (pwrite(in, data, size, 0) != (ssize_t)size ||
+            ftruncate(in, (off_t)size) != 0 || ftruncate(out, 0) != 0 ||
+            lseek(out, 0, SEEK_SET) != 0) {
+            perror("could not prepare files");
+            return 1;
+        }
+
+        running = true;
+        alarm_len = (size_t)snprintf(alarm_msg, sizeof(alarm_msg),
+                                     "timeout: seed %llu, ring variant %s\n",
+                                     run_seed, RINGBUF);
+        if (alarm_len >= sizeof(alarm_msg))
+            alarm_len = sizeof(alarm_msg) - 1;
+        alarm(run_timeout(threads, ncpus));
+        int r = ccat_main(cargc, cargv);
+        alarm(0);
+        running = false;
+
+        ssize_t got = pread(out, back, MAX_FILE_SIZE + 1, 0);
+        if (r != 0 || got != (ssize_t)size ||
+            crc32c(0, back, size) != crc32c(0, data, size)) {
+            fprintf(stderr,
+                    "output differs: %zd of %zu bytes, -j %u -m %u%s -W %s, "
+                    "chunk %u, free %u, rbuf %u, reorder %u\n",
+                    got, size, readers, mediators, unfused ? " -F" : "",
+                    policies, chunk_size, free_len, rbuf_len, reorder_len);
+            report("failed");
+            flight_dump("output differs");
+            return 1;
+        }
+        if ((i + 1) % 1000 == 0)
+            fprintf(stderr, "%lu runs\n", i + 1);
+    }
+    fprintf(stderr, "no differences found in %lu runs\n", iterations);
+    return 0;
+}
@@ -0,0 +1,233 @@
+/*
+ * Copyright (C) Huawei Technologies Co., Ltd. 2026. All rights reserved.
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef TRACE_H
+#define TRACE_H
+/*******************************************************************************
+ * Traces of what the threads of a pipeline do over time, written in the Chrome
+ * Trace Event format that Perfetto (ui.perfetto.dev) and chrome://tracing
+ * open.
+ *
+ * Each thread records 16-byte binary events into a buffer of its own, without
+ * locks or atomics.  An event begins or ends a slice: the life of the stage, a
+ * batch of work, a wait for a ring or a system call.  The buffers grow up to
+ * TRACE_MAX_EVENTS events each, and the events past that are counted but not
+ * kept.  trace_write() turns the buffers into JSON once the threads are done,
+ * one track per thread, and closes the slices left open.
+ *
+ * A thread without a buffer, as when tracing is off, pays a branch per event.
+ ******************************************************************************/
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vsync/atomic.h>
+
+#include "now.h"
+
+#define TRACE_THREADS 256
+#define TRACE_MIN_EVENTS 4096
+#define TRACE_MAX_EVENTS (1U << 22)
+#define TRACE_DEPTH 16 /* nesting of the slices */
+
+enum trace_name {
+    TRACE_STAGE,  /* the life of the thread, named after it */
+    TRACE_WAIT,   /* waiting for a ring, see wait.h */
+    TRACE_WORK,   /* a batch of chunks, the argument is their number */
+    TRACE_READ,   /* a read system call, the argument is its size */
+    TRACE_WRITE,  /* a write system call, the argument is its size */
+    TRACE_SUBMIT, /* an io_uring_enter call, the argument is its I/Os */
+    TRACE_NAMES,
+};
+
+static const char *trace_names[TRACE_NAMES] = {
+    "stage", "wait", "work", "read", "write", "submit",
+};
+
+struct trace_event {
+    nanosec_t ts;
+    uint32_t arg;
+    uint16_t name; /* enum trace_name */
+    char phase;    /* 'B' or 'E', as in the JSON */
+};
+
+struct trace_buf {
+    struct trace_event *ev;
+    unsigned int n;
+    unsigned int cap;
+    unsigned long dropped;
+    char name[24];
+};
+
+static struct trace_buf *trace_bufs[TRACE_THREADS];
+static vatomic32_t trace_nbufs;
+static bool trace_on;
+static nanosec_t trace_epoch;
+
+/* starts tracing the threads that call trace_thread() from now on */
+static inline void
+trace_start(void)
+{
+    trace_on = true;
+    trace_epoch = now();
+    vatomic32_write(&trace_nbufs, 0);
+}
+
+/* returns the buffer of the calling thread, named name and id, or NULL if
+ * tracing is off */
+static inline struct trace_buf *
+trace_thread(const char *name, unsigned int id)
+{
+    struct trace_buf *b;
+    unsigned int k;
+
+    if (!trace_on)
+        return NULL;
+    k = vatomic32_get_inc(&trace_nbufs);
+    if (k >= TRACE_THREADS)
+        return NULL;
+    if ((b = calloc(1, sizeof(struct trace_buf))) == NULL) {
+        perror("trace malloc");
+        exit(EXIT_FAILURE);
+    }
+    snprintf(b->name, sizeof(b->name), "%s %u", name, id);
+    trace_bufs[k] = b;
+    return b;
+}
+
+/* doubles the room for events of b, returns false at TRACE_MAX_EVENTS */
+static inline bool
+trace_grow(struct trace_buf *b)
+{
+    unsigned int cap = b->cap ? 2 * b->cap : TRACE_MIN_EVENTS;
+    struct trace_event *ev;
+
+    if (cap > TRACE_MAX_EVENTS)
+        return false;
+    if ((ev = realloc(b->ev, cap * sizeof(struct trace_event))) == NULL)
+        return false;
+    b->ev = ev;
+    b->cap = cap;
+    return true;
+}
+
+static inline void
+trace_record(struct trace_buf *b, enum trace_name name, char phase,
+             uint32_t arg)
+{
+    if (b->n == b->cap && !trace_grow(b)) {
+        b->dropped++;
+        return;
+    }
+    b->ev[b->n++] = (struct trace_event){now(), arg, (uint16_t)name, phase};
+}
+
+/* begins a slice in the trace of b, if any */
+static inline void
+trace_begin(struct trace_buf *b, enum trace_name name, uint32_t arg)
+{
+    if (b != NULL)
+        trace_record(b, name, 'B', arg);
+}
+
+/* ends the innermost slice in the trace of b, if any */
+static inline void
+trace_end(struct trace_buf *b, enum trace_name name)
+{
+    if (b != NULL)
+        trace_record(b, name, 'E', 0);
+}
+
+static inline void
+trace_write_event(FILE *fp, const struct trace_buf *b, unsigned int tid,
+                  const struct trace_event *e)
+{
+    const char *name =
+        e->name == TRACE_STAGE ? b->name : trace_names[e->name];
+
+    fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,"
+                "\"tid\":%u",
+            name, e->phase, (double)(e->ts - trace_epoch) / NOW_MICROSECOND,
+            tid);
+    if (e->phase == 'B' && e->name != TRACE_STAGE)
+        fprintf(fp, ",\"args\":{\"n\":%u}", e->arg);
+    fprintf(fp, "}");
+}
+
+/* writes the traces of all threads of the process to path as JSON, returns
+ * -1 on error */
+static inline int
+trace_write(const char *path, const char *process)
+{
+    unsigned int n = vatomic32_read(&trace_nbufs);
+    FILE *fp = fopen(path, "w");
+
+    if (fp == NULL) {
+        perror("could not open trace");
+        return -1;
+    }
+    if (n > TRACE_THREADS)
+        n = TRACE_THREADS;
+    fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n"
+                "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+                "\"args\":{\"name\":\"%s\"}}",
+            process);
+    for (unsigned int i = 0; i < n; i++) {
+        struct trace_buf *b = trace_bufs[i];
+        struct trace_event open[TRACE_DEPTH];
+        unsigned int depth = 0;
+
+        if (b == NULL)
+            continue;
+        fprintf(fp,
+                ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                "\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                i + 1, b->name);
+        for (unsigned int k = 0; k < b->n; k++) {
+            struct trace_event *e = &b->ev[k];
+
+            if (e->phase == 'B' && depth < TRACE_DEPTH)
+                open[depth++] = *e;
+            else if (e->phase == 'E' && depth > 0)
+                depth--;
+            trace_write_event(fp, b, i + 1, e);
+        }
+
+        /* the slices cut short by a full buffer end with its last event */
+        while (depth > 0) {
+            struct trace_event e = open[--depth];
+
+            e.phase = 'E';
+            e.ts = b->ev[b->n - 1].ts;
+            trace_write_event(fp, b, i + 1, &e);
+        }
+        if (b->dropped > 0)
+            fprintf(stderr, "trace of %s: %lu events dropped\n", b->name,
+                    b->dropped);
+    }
+    fprintf(fp, "\n]}\n");
+    if (fclose(fp) != 0) {
+        perror("could not write trace");
+        return -1;
+    }
+    return 0;
+}
+
+/* frees the traces and stops tracing */
+static inline void
+trace_fini(void)
+{
+    unsigned int n = vatomic32_read(&trace_nbufs);
+
+    for (unsigned int i = 0; i < n && i < TRACE_THREADS; i++) {
+        if (trace_bufs[i] != NULL)
+            free(trace_bufs[i]->ev);
+        free(trace_bufs[i]);
+        trace_bufs[i] = NULL;
+    }
+    vatomic32_write(&trace_nbufs, 0);
+    trace_on = false;
+}
+
+#endif
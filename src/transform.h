@@ -0,0 +1,1074 @@
+/*
+ * Copyright (C) Huawei Technologies Co., Ltd. 2026. All rights reserved.
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+/*******************************************************************************
+ * Transforms applied by the mediators to the chunks on their way to the writer.
+ *
+ * A transform gets batches of chunk payloads.  In-place transforms (bound is
+ * NULL) rewrite the bytes where they are, the others write to an output buffer
+ * of bound(len) bytes and set its length.  Each mediator calls init() to get
+ * its own state.  Transforms that carry state from one chunk to the next must
+ * set `ordered`: they then run on a single mediator that sees the chunks in
+ * stream order.
+ *
+ * Ordered transforms may also produce more output than fits the output buffer
+ * of a chunk, or hold output back.  Their flush() is called after each chunk,
+ * and at the end of the stream, until it returns 0; what it writes goes to the
+ * writer right after the output of the chunk.
+ *
+ * Transforms that compute a result instead of rewriting the data, such as wc,
+ * empty the chunks so that nothing is written, and reduce() combines the
+ * states of all mediators into the result once the stream has ended.
+ *
+ * Transforms that work on blocks larger than a chunk, such as lz4, set
+ * `group` to the block size.  The reader then sends each group of consecutive
+ * chunks that make up a block to one mediator, which passes the whole group
+ * to process() at once, the end of file marker included at the end.  The
+ * output of the group is spread over the output buffers of its chunks.
+ ******************************************************************************/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vsync/atomic.h>
+
+#include "kernels.h"
+
+struct span {
+    char *data;
+    size_t len;
+    unsigned int seq; /* position of the chunk in the stream */
+    bool eof;         /* end of file marker, only seen with a group */
+};
+
+struct transform {
+    const char *name;
+    const char *help;
+    bool ordered;
+    size_t group; /* bytes of input processed together, 0 for none */
+    /* maximum output size for len input bytes, NULL for in place */
+    size_t (*bound)(size_t len);
+    /* returns the state of one mediator, NULL if arg is invalid */
+    void *(*init)(const char *arg);
+    /* transforms in[i] into out[i], out is in for in-place transforms */
+    void (*process)(void *state, const struct span *in, struct span *out,
+                    unsigned int n);
+    /* writes at most room bytes of held back output to out, returns their
+     * length, eof is set at the end of the stream (may be NULL) */
+    size_t (*flush)(void *state, char *out, size_t room, bool eof);
+    /* prints the result from the states of the n mediators (may be NULL) */
+    void (*reduce)(void **states, unsigned int n);
+    void (*fini)(void *state);
+};
+
+/* tr SET1:SET2 */
+
+struct tr_state {
+    const struct kernels *k;
+    struct byte_map map;
+};
+
+#define TR_SET_MAX 1024
+
+/* expands a-z ranges of set into out, returns the expanded length */
+static inline size_t
+tr_expand(const char *set, size_t len, unsigned char *out)
+{
+    size_t n = 0;
+
+    for (size_t i = 0; i < len && n + 256 <= TR_SET_MAX; i++) {
+        unsigned char c = (unsigned char)set[i];
+        if (i + 2 < len && set[i + 1] == '-' &&
+            (unsigned char)set[i + 2] >= c) {
+            for (unsigned int x = c; x <= (unsigned char)set[i + 2]; x++)
+                out[n++] = (unsigned char)x;
+            i += 2;
+        } else {
+            out[n++] = c;
+        }
+    }
+    return n;
+}
+
+static inline void *
+tr_init(const char *arg)
+{
+    const char *sep = arg ? strchr(arg, ':') : NULL;
+    unsigned char from[TR_SET_MAX], to[TR_SET_MAX];
+    struct tr_state *s;
+
+    if (sep == NULL || sep[1] == 0) {
+        fprintf(stderr, "tr needs SET1:SET2\n");
+        return NULL;
+    }
+    if ((s = malloc(sizeof(*s))) == NULL) {
+        perror("transform malloc");
+        exit(EXIT_FAILURE);
+    }
+    size_t nfrom = tr_expand(arg, (size_t)(sep - arg), from);
+    size_t nto = tr_expand(sep + 1, strlen(sep + 1), to);
+
+    /* as in tr, SET2 is extended with its last character */
+    s->k = kernels_best();
+    byte_map_init(&s->map);
+    for (size_t i = 0; i < nfrom; i++)
+        s->map.table[from[i]] = i < nto ? to[i] : to[nto - 1];
+    byte_map_ranges(&s->map);
+    return s;
+}
+
+static inline void
+tr_process(void *state, const struct span *in, struct span *out,
+           unsigned int n)
+{
+    struct tr_state *s = (struct tr_state *)state;
+    for (unsigned int i = 0; i < n; i++)
+        s->k->map(&s->map, in[i].data, in[i].len);
+}
+
+/* lower and upper */
+
+struct fold_state {
+    const struct kernels *k;
+    bool upper;
+};
+
+static inline void *
+fold_init(bool upper)
+{
+    struct fold_state *s = malloc(sizeof(*s));
+    if (s == NULL) {
+        perror("transform malloc");
+        exit(EXIT_FAILURE);
+    }
+    s->k = kernels_best();
+    s->upper = upper;
+    return s;
+}
+
+static inline void *
+lower_init(const char *arg)
+{
+    return fold_init(false);
+}
+
+static inline void *
+upper_init(const char *arg)
+{
+    return fold_init(true);
+}
+
+static inline void
+fold_process(void *state, const struct span *in, struct span *out,
+             unsigned int n)
+{
+    struct fold_state *s = (struct fold_state *)state;
+    for (unsigned int i = 0; i < n; i++)
+        s->k->fold(in[i].data, in[i].len, s->upper);
+}
+
+/* escape, as cat -v */
+
+static inline size_t
+escape_bound(size_t len)
+{
+    return 4 * len;
+}
+
+static inline void *
+escape_init(const char *arg)
+{
+    return (void *)kernels_best();
+}
+
+static inline void
+escape_process(void *state, const struct span *in, struct span *out,
+               unsigned int n)
+{
+    const struct kernels *k = (const struct kernels *)state;
+    for (unsigned int i = 0; i < n; i++)
+        out[i].len = k->escape(in[i].data, in[i].len, out[i].data);
+}
+
+/* number and nonblank, as cat -n and cat -b */
+
+#define NUMBER_MAX 24 /* room for a 64-bit line number and a tab */
+
+struct number_state {
+    const struct kernels *k;
+    bool nonblank;   /* skip empty lines */
+    bool line_start; /* the next byte starts a line */
+    size_t plen;     /* prefix length */
+    char prefix[NUMBER_MAX];
+};
+
+static inline void
+number_state_init(struct number_state *s, const struct kernels *k,
+                  bool nonblank)
+{
+    s->k = k;
+    s->nonblank = nonblank;
+    s->line_start = true;
+    memset(s->prefix, ' ', NUMBER_MAX);
+    memcpy(s->prefix + NUMBER_MAX - 2, "1\t", 2);
+    s->plen = 7; /* "%6d\t" */
+}
+
+/* increments the decimal line number in the prefix, growing it past six
+ * digits if needed */
+static inline void
+number_next(struct number_state *s)
+{
+    char *p = s->prefix + NUMBER_MAX - 2;
+
+    while (*p == '9')
+        *p-- = '0';
+    *p = *p == ' ' ? '1' : *p + 1;
+    if (p < s->prefix + NUMBER_MAX - s->plen)
+        s->plen++;
+}
+
+/* copies a piece of a line to out with the line number in front if it
+ * starts a line, eol tells if it ends with a newline */
+static inline size_t
+number_piece(struct number_state *s, const char *p, size_t len, bool eol,
+             char *out)
+{
+    size_t o = 0;
+
+    if (s->line_start && !(s->nonblank && eol && len == 1)) {
+        memcpy(out, s->prefix + NUMBER_MAX - s->plen, s->plen);
+        o = s->plen;
+        number_next(s);
+    }
+    memcpy(out + o, p, len);
+    s->line_start = eol;
+    return o + len;
+}
+
+/* numbers the lines of in, the newlines are found a block at a time and
+ * each line is copied as a whole */
+static inline size_t
+number_chunk(struct number_state *s, const char *in, size_t n, char *out)
+{
+    char block[EOL_BLOCK];
+    size_t o = 0, pos = 0;
+
+    for (size_t b = 0; b < n; b += EOL_BLOCK) {
+        uint64_t m;
+
+        if (n - b >= EOL_BLOCK) {
+            m = s->k->eol(in + b);
+        } else {
+            memset(block, 0, EOL_BLOCK);
+            memcpy(block, in + b, n - b);
+            m = s->k->eol(block);
+        }
+        for (; m != 0; m &= m - 1) {
+            size_t end = b + (size_t)__builtin_ctzll(m) + 1;
+            o += number_piece(s, in + pos, end - pos, true, out + o);
+            pos = end;
+        }
+    }
+    if (pos < n)
+        o += number_piece(s, in + pos, n - pos, false, out + o);
+    return o;
+}
+
+static inline size_t
+number_bound(size_t len)
+{
+    return len * (NUMBER_MAX + 1);
+}
+
+static inline void *
+number_init(bool nonblank)
+{
+    struct number_state *s = malloc(sizeof(*s));
+    if (s == NULL) {
+        perror("transform malloc");
+        exit(EXIT_FAILURE);
+    }
+    number_state_init(s, kernels_best(), nonblank);
+    return s;
+}
+
+static inline void *
+number_all_init(const char *arg)
+{
+    return number_init(false);
+}
+
+static inline void *
+number_nonblank_init(const char *arg)
+{
+    return number_init(true);
+}
+
+static inline void
+number_process(void *state, const struct span *in, struct span *out,
+               unsigned int n)
+{
+    struct number_state *s = (struct number_state *)state;
+    for (unsigned int i = 0; i < n; i++)
+        out[i].len = number_chunk(s, in[i].data, in[i].len, out[i].data);
+}
+
+/* grep:PATTERN, lines that contain PATTERN as grep -F */
+
+struct bytes {
+    char *p;
+    size_t len;
+    size_t cap;
+};
+
+/* makes room for len more bytes */
+static inline void
+bytes_reserve(struct bytes *b, size_t len)
+{
+    if (b->len + len > b->cap) {
+        size_t cap = b->cap ? b->cap : 256;
+        while (cap < b->len + len)
+            cap *= 2;
+        if ((b->p = realloc(b->p, cap)) == NULL) {
+            perror("transform malloc");
+            exit(EXIT_FAILURE);
+        }
+        b->cap = cap;
+    }
+}
+
+static inline void
+bytes_add(struct bytes *b, const char *p, size_t len)
+{
+    bytes_reserve(b, len);
+    memcpy(b->p + b->len, p, len);
+    b->len += len;
+}
+
+struct grep_state {
+    const struct kernels *k;
+    const char *pat;
+    size_t m;
+    bool matched;      /* the current line matched, pass it on to its end */
+    struct bytes hold; /* start of the current line, not matched yet */
+    struct bytes pend; /* output not passed on yet */
+    size_t sent;       /* bytes of pend already passed on */
+};
+
+/* returns the offset of the first match in h, or n */
+static inline size_t
+grep_find(struct grep_state *s, const char *h, size_t n)
+{
+    if (s->m == 0)
+        return n > 0 ? 0 : n;
+    return s->k->find(h, n, s->pat, s->m);
+}
+
+/* returns the offset of the line that contains h[at] */
+static inline size_t
+grep_line_start(const char *h, size_t at)
+{
+    while (at > 0 && h[at - 1] != '\n')
+        at--;
+    return at;
+}
+
+/* returns the offset past the newline that ends the line at h, or n if the
+ * line goes on in the next chunk */
+static inline size_t
+grep_line_end(const char *h, size_t n)
+{
+    const char *nl = memchr(h, '\n', n);
+    return nl ? (size_t)(nl - h) + 1 : n;
+}
+
+/* filters the lines of one chunk into s->pend */
+static inline void
+grep_chunk(struct grep_state *s, const char *d, size_t n)
+{
+    size_t pos = 0;
+
+    /* finish the line started in an earlier chunk */
+    if (s->matched || s->hold.len > 0) {
+        size_t end = grep_line_end(d, n);
+
+        if (s->matched) {
+            bytes_add(&s->pend, d, end);
+        } else {
+            /* only matches that reach into the new data are new */
+            size_t from = s->hold.len >= s->m ? s->hold.len - s->m + 1 : 0;
+            bytes_add(&s->hold, d, end);
+            if (grep_find(s, s->hold.p + from, s->hold.len - from) <
+                s->hold.len - from) {
+                bytes_add(&s->pend, s->hold.p, s->hold.len);
+                s->matched = true;
+            }
+        }
+        if (s->matched || d[end - 1] == '\n')
+            s->hold.len = 0;
+        if (d[end - 1] == '\n')
+            s->matched = false;
+        pos = end;
+    }
+
+    /* the lines that start in this chunk, lines without a match are skipped
+     * without looking at them one by one */
+    while (pos < n) {
+        size_t at = grep_find(s, d + pos, n - pos);
+
+        if (at == n - pos) {
+            size_t start = grep_line_start(d + pos, n - pos);
+            bytes_add(&s->hold, d + pos + start, n - pos - start);
+            break;
+        }
+        at += pos;
+        size_t start = pos + grep_line_start(d + pos, at - pos);
+        size_t end = at + grep_line_end(d + at, n - at);
+        bytes_add(&s->pend, d + start, end - start);
+        if (d[end - 1] != '\n') {
+            s->matched = true;
+            break;
+        }
+        pos = end;
+    }
+}
+
+/* moves up to room bytes of pending output to out */
+static inline size_t
+grep_output(struct grep_state *s, char *out, size_t room)
+{
+    size_t len = s->pend.len - s->sent;
+
+    if (len > room)
+        len = room;
+    memcpy(out, s->pend.p + s->sent, len);
+    s->sent += len;
+    if (s->sent == s->pend.len)
+        s->sent = s->pend.len = 0;
+    return len;
+}
+
+static inline size_t
+grep_bound(size_t len)
+{
+    return len;
+}
+
+static inline void *
+grep_init(const char *arg)
+{
+    struct grep_state *s;
+
+    if (arg == NULL || strchr(arg, '\n') != NULL) {
+        fprintf(stderr, "grep needs a pattern without newlines\n");
+        return NULL;
+    }
+    if ((s = calloc(1, sizeof(*s))) == NULL) {
+        perror("transform malloc");
+        exit(EXIT_FAILURE);
+    }
+    s->k = kernels_best();
+    s->pat = arg;
+    s->m = strlen(arg);
+    return s;
+}
+
+static inline void
+grep_process(void *state, const struct span *in, struct span *out,
+             unsigned int n)
+{
+    struct grep_state *s = (struct grep_state *)state;
+
+    for (unsigned int i = 0; i < n; i++) {
+        grep_chunk(s, in[i].data, in[i].len);
+        out[i].len = grep_output(s, out[i].data, grep_bound(in[i].len));
+    }
+}
+
+/* as grep, a matching last line gets a newline */
+static inline size_t
+grep_flush(void *state, char *out, size_t room, bool eof)
+{
+    struct grep_state *s = (struct grep_state *)state;
+
+    if (eof && s->matched) {
+        bytes_add(&s->pend, "\n", 1);
+        s->matched = false;
+    }
+    return grep_output(s, out, room);
+}
+
+static inline void
+grep_fini(void *state)
+{
+    struct grep_state *s = (struct grep_state *)state;
+    free(s->hold.p);
+    free(s->pend.p);
+    free(s);
+}
+
+/* wc, counts of the whole stream from partial counts of the chunks.
+ *
+ * As GNU wc in the C locale, a word is a run of bytes between white space
+ * that has at least one printable byte; other bytes neither start nor end a
+ * word.  Each chunk is counted as if no word was going on before it, and
+ * remembers the kind of its first and last significant bytes (white space
+ * or printable).  The words that go on from one chunk to the next are then
+ * taken off, walking these edges in stream order.
+ *
+ * The mediators share the edges in a window of WC_WINDOW chunks indexed by
+ * seq, and whichever publishes the next edge folds the edges that are in
+ * order into the count, so the window does not grow with the stream and
+ * survives the wrap-around of seq.  ccat lets no chunk run further ahead of
+ * the writer than its reorder buffer, which is smaller than the window, so a
+ * mediator only waits for a slot while another one is folding it. */
+
+#define WC_WINDOW 1024 /* chunks, a power of two */
+#define WC_SET 8       /* the slot holds the edges of a chunk */
+
+enum { WC_NONE, WC_SPACE, WC_WORD };
+
+struct wc_edges {
+    vatomic32_t edge[WC_WINDOW]; /* of chunk seq at seq % WC_WINDOW */
+    vatomic32_t next;            /* first chunk not folded */
+    vatomic32_t folding;         /* a mediator is folding */
+    bool in;                     /* a word goes on before chunk next */
+    unsigned long long joined;   /* words that go on across chunks */
+    unsigned int users;          /* mediators */
+};
+
+/* the edges of the running stream, shared by the states of its mediators */
+static struct wc_edges *wc_edges;
+
+struct wc_state {
+    const struct kernels *k;
+    unsigned long long bytes, lines, words;
+    struct wc_edges *edges;
+};
+
+/* counts len bytes of p, returns the edges of the chunk: bit 0 is set if the
+ * first significant byte is printable, bits 1-2 are the kind of the last */
+static inline unsigned int
+wc_chunk(struct wc_state *s, const char *p, size_t len)
+{
+    char tail[EOL_BLOCK];
+    uint64_t in = 0; /* a word is going on */
+    unsigned int first = WC_NONE, last = WC_NONE;
+
+    s->bytes += len;
+    for (size_t i = 0; i < len; i += EOL_BLOCK) {
+        const char *b = p + i;
+        uint64_t valid = ~0ULL, sp, gr;
+
+        if (len - i < EOL_BLOCK) {
+            memset(tail, 0, EOL_BLOCK);
+            memcpy(tail, b, len - i);
+            b = tail;
+            valid = (1ULL << (len - i)) - 1;
+        }
+        s->lines += (unsigned long long)__builtin_popcountll(s->k->eol(b));
+        s->k->words(b, &sp, &gr);
+        sp &= valid;
+        gr &= valid;
+
+        /* a word goes on through the other bytes: the carry of the addition
+         * runs through each run of them that follows a printable byte */
+        uint64_t other = ~(sp | gr) & valid;
+        uint64_t from = (gr << 1 | in) & other;
+        uint64_t word = gr | (((from + other) ^ other) & other);
+        s->words += (unsigned long long)__builtin_popcountll(
+            gr & ~(word << 1 | in));
+
+        uint64_t sig = sp | gr;
+        if (sig != 0) {
+            if (first == WC_NONE)
+                first = gr >> __builtin_ctzll(sig) & 1 ? WC_WORD : WC_SPACE;
+            last = gr >> (63 - __builtin_clzll(sig)) & 1 ? WC_WORD : WC_SPACE;
+        }
+        in = word >> 63;
+    }
+    return (first == WC_WORD) | last << 1;
+}
+
+static inline void *
+wc_init(const char *arg)
+{
+    struct wc_state *s = calloc(1, sizeof(*s));
+    if (s == NULL || (wc_edges == NULL &&
+                      (wc_edges = calloc(1, sizeof(*wc_edges))) == NULL)) {
+        perror("transform malloc");
+        exit(EXIT_FAILURE);
+    }
+    s->k = kernels_best();
+    s->edges = wc_edges;
+    wc_edges->users++;
+    return s;
+}
+
+/* folds the edges that are in order, unless another mediator is at it, and
+ * then looks again for an edge published while it was */
+static inline void
+wc_fold(struct wc_edges *w)
+{
+    do {
+        if (vatomic32_cmpxchg(&w->folding, 0, 1) != 0)
+            return;
+        for (;;) {
+            unsigned int seq = vatomic32_read_rlx(&w->next);
+            vatomic32_t *slot = &w->edge[seq % WC_WINDOW];
+            unsigned int e = vatomic32_read_acq(slot);
+
+            if (e == 0)
+                break;
+            if ((e & 1) && w->in)
+                w->joined++;
+            if ((e >> 1 & 3) != WC_NONE)
+                w->in = (e >> 1 & 3) == WC_WORD;
+            vatomic32_write_rlx(slot, 0);
+            vatomic32_write_rel(&w->next, seq + 1);
+        }
+        vatomic32_write(&w->folding, 0);
+    } while (vatomic32_read(&w->edge[vatomic32_read(&w->next) % WC_WINDOW]));
+}
+
+static inline void
+wc_process(void *state, const struct span *in, struct span *out,
+           unsigned int n)
+{
+    struct wc_state *s = (struct wc_state *)state;
+
+    for (unsigned int i = 0; i < n; i++) {
+        unsigned int e = wc_chunk(s, in[i].data, in[i].len);
+        vatomic32_t *slot = &s->edges->edge[in[i].seq % WC_WINDOW];
+
+        /* the chunk WC_WINDOW before leaves the slot once folded */
+        vatomic32_await_eq(slot, 0);
+        vatomic32_write(slot, e | WC_SET);
+        wc_fold(s->edges);
+        out[i].len = 0;
+    }
+}
+
+/* prints the counts as wc does for stdin */
+static inline void
+wc_reduce(void **states, unsigned int n)
+{
+    unsigned long long bytes = 0, lines = 0, words = 0;
+
+    for (unsigned int i = 0; i < n; i++) {
+        struct wc_state *s = (struct wc_state *)states[i];
+        bytes += s->bytes;
+        lines += s->lines;
+        words += s->words;
+    }
+    words -= n > 0 ? ((struct wc_state *)states[0])->edges->joined : 0;
+    printf("%7llu %7llu %7llu\n", lines, words, bytes);
+}
+
+static inline void
+wc_fini(void *state)
+{
+    struct wc_state *s = (struct wc_state *)state;
+
+    if (--s->edges->users == 0) {
+        free(s->edges);
+        wc_edges = NULL;
+    }
+    free(s);
+}
+
+/* hex and base64, as xxd -p and base64.
+ *
+ * The lines of the output have a fixed length wherever the chunks start, and
+ * base64 keeps the bytes of an incomplete 3-byte group for the next chunk, so
+ * both are ordered.  A chunk is encoded in one go and then copied out line by
+ * line. */
+
+#define HEX_WIDTH 60
+#define BASE64_WIDTH 76
+
+struct encode_state {
+    const struct kernels *k;
+    bool base64;
+    unsigned int width; /* characters per line */
+    unsigned int col;   /* characters in the current line */
+    unsigned int npend; /* base64 bytes kept for the next chunk */
+    char pend[3];
+    struct bytes text; /* encoded chunk */
+};
+
+/* room for the characters of len bytes and a pending base64 group, and for
+ * the newlines between them */
+static inline size_t
+encode_bound(size_t len)
+{
+    return 2 * len + len / 30 + 8;
+}
+
+static inline void *
+encode_init(bool base64)
+{
+    struct encode_state *s = calloc(1, sizeof(*s));
+    if (s == NULL) {
+        perror("transform malloc");
+        exit(EXIT_FAILURE);
+    }
+    s->k = kernels_best();
+    s->base64 = base64;
+    s->width = base64 ? BASE64_WIDTH : HEX_WIDTH;
+    return s;
+}
+
+static inline void *
+hex_init(const char *arg)
+{
+    return encode_init(false);
+}
+
+static inline void *
+base64_init(const char *arg)
+{
+    return encode_init(true);
+}
+
+/* copies the encoded text to out, cut in lines, returns the output length */
+static inline size_t
+encode_lines(struct encode_state *s, char *out)
+{
+    size_t o = 0;
+
+    for (size_t i = 0; i < s->text.len;) {
+        size_t n = s->width - s->col;
+        if (n > s->text.len - i)
+            n = s->text.len - i;
+        memcpy(out + o, s->text.p + i, n);
+        o += n;
+        i += n;
+        s->col += (unsigned int)n;
+        if (s->col == s->width) {
+            out[o++] = '\n';
+            s->col = 0;
+        }
+    }
+    s->text.len = 0;
+    return o;
+}
+
+/* encodes len bytes of p to text, 3-byte groups only for base64 */
+static inline void
+encode_text(struct encode_state *s, const char *p, size_t len)
+{
+    size_t n = s->base64 ? len / 3 * 4 : 2 * len;
+
+    bytes_reserve(&s->text, n);
+    if (s->base64)
+        s->k->base64(p, len, s->text.p + s->text.len);
+    else
+        s->k->hex(p, len, s->text.p + s->text.len);
+    s->text.len += n;
+}
+
+static inline void
+encode_process(void *state, const struct span *in, struct span *out,
+               unsigned int n)
+{
+    struct encode_state *s = (struct encode_state *)state;
+
+    for (unsigned int i = 0; i < n; i++) {
+        const char *p = in[i].data;
+        size_t len = in[i].len;
+
+        /* complete the group left over by the previous chunk */
+        if (s->npend > 0) {
+            while (s->npend < 3 && len > 0) {
+                s->pend[s->npend++] = *p++;
+                len--;
+            }
+            if (s->npend < 3) {
+                out[i].len = 0;
+                continue;
+            }
+            encode_text(s, s->pend, 3);
+            s->npend = 0;
+        }
+        size_t whole = s->base64 ? len / 3 * 3 : len;
+        encode_text(s, p, whole);
+        memcpy(s->pend, p + whole, len - whole);
+        s->npend = (unsigned int)(len - whole);
+        out[i].len = encode_lines(s, out[i].data);
+    }
+}
+
+/* at the end, base64 pads the last group, and the last line gets a newline */
+static inline size_t
+encode_flush(void *state, char *out, size_t room, bool eof)
+{
+    struct encode_state *s = (struct encode_state *)state;
+    size_t o;
+
+    if (!eof)
+        return 0;
+    if (s->npend > 0) {
+        char last[3] = {0, 0, 0};
+        memcpy(last, s->pend, s->npend);
+        encode_text(s, last, 3);
+        memset(s->text.p + s->text.len - (3 - s->npend), '=', 3 - s->npend);
+        s->npend = 0;
+    }
+    o = encode_lines(s, out);
+    if (s->col > 0) {
+        out[o++] = '\n';
+        s->col = 0;
+    }
+    return o;
+}
+
+static inline void
+encode_fini(void *state)
+{
+    struct encode_state *s = (struct encode_state *)state;
+    free(s->text.p);
+    free(s);
+}
+
+/* lz4, compresses each group into an LZ4 frame block.
+ *
+ * The blocks are independent, so that the mediators can compress them in
+ * parallel, and the frame has no checksums, which would have to be computed
+ * over the whole stream in order.  The compressor is the usual greedy one:
+ * a hash of the next 4 bytes gives the last position that had the same hash,
+ * which is a match if it has the same 4 bytes. */
+
+#define LZ4_GROUP (64 * 1024) /* block size, as declared in the frame */
+#define LZ4_HASH_LOG 12
+#define LZ4_MIN_MATCH 4
+#define LZ4_LAST_LITERALS 5 /* a block ends with at least 5 literals */
+#define LZ4_MF_LIMIT 12     /* and its last match starts 12 bytes before */
+#define LZ4_OVERHEAD 16     /* frame header, block size and end mark */
+
+/* magic number, FLG (version 1, independent blocks), BD (64 KiB blocks) and
+ * the header checksum, the second byte of the xxh32 of FLG and BD */
+static const unsigned char lz4_header[7] = {0x04, 0x22, 0x4d, 0x18,
+                                            0x60, 0x40, 0x82};
+
+struct lz4_state {
+    unsigned char block[LZ4_GROUP];
+    unsigned char buf[LZ4_GROUP + LZ4_OVERHEAD];
+    uint16_t table[1 << LZ4_HASH_LOG]; /* positions in block */
+};
+
+/* the output of a chunk can take its share of the output of the group */
+static inline size_t
+lz4_bound(size_t len)
+{
+    return len + LZ4_OVERHEAD;
+}
+
+static inline uint32_t
+lz4_read32(const unsigned char *p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static inline unsigned int
+lz4_hash(uint32_t v)
+{
+    return (v * 2654435761U) >> (32 - LZ4_HASH_LOG);
+}
+
+static inline unsigned char *
+lz4_write32(unsigned char *op, uint32_t v)
+{
+    for (int i = 0; i < 4; i++)
+        *op++ = (unsigned char)(v >> (8 * i));
+    return op;
+}
+
+/* writes the bytes of a length above 15 that the token cannot hold */
+static inline unsigned char *
+lz4_length(unsigned char *op, size_t len)
+{
+    for (len -= 15; len >= 255; len -= 255)
+        *op++ = 255;
+    *op++ = (unsigned char)len;
+    return op;
+}
+
+/* writes a sequence of nlit literals followed by a match of mlen bytes at
+ * offset off, or by nothing if off is 0 */
+static inline unsigned char *
+lz4_sequence(unsigned char *op, const unsigned char *lit, size_t nlit,
+             size_t off, size_t mlen)
+{
+    unsigned char *token = op++;
+    size_t ml = off ? mlen - LZ4_MIN_MATCH : 0;
+
+    *token = (unsigned char)((nlit < 15 ? nlit : 15) << 4 |
+                             (ml < 15 ? ml : 15));
+    if (nlit >= 15)
+        op = lz4_length(op, nlit);
+    memcpy(op, lit, nlit);
+    op += nlit;
+    if (off) {
+        *op++ = (unsigned char)off;
+        *op++ = (unsigned char)(off >> 8);
+        if (ml >= 15)
+            op = lz4_length(op, ml);
+    }
+    return op;
+}
+
+/* compresses n bytes of src into dst, returns the compressed length, which
+ * may be larger than n */
+static inline size_t
+lz4_compress(struct lz4_state *s, const unsigned char *src, size_t n,
+             unsigned char *dst)
+{
+    const unsigned char *ip = src, *anchor = src, *end = src + n;
+    unsigned char *op = dst;
+
+    memset(s->table, 0, sizeof(s->table));
+    for (unsigned int miss = 0; n > LZ4_MF_LIMIT && ip < end - LZ4_MF_LIMIT;) {
+        uint32_t v = lz4_read32(ip);
+        unsigned int h = lz4_hash(v);
+        const unsigned char *ref = src + s->table[h];
+
+        s->table[h] = (uint16_t)(ip - src);
+        if (ref >= ip || lz4_read32(ref) != v) {
+            /* skip faster through data that does not compress */
+            ip += 1 + (miss++ >> 6);
+            continue;
+        }
+        miss = 0;
+
+        /* extend the match backwards into the literals and forwards */
+        while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+            ip--;
+            ref--;
+        }
+        const unsigned char *m = ip + LZ4_MIN_MATCH;
+        const unsigned char *r = ref + LZ4_MIN_MATCH;
+        while (m < end - LZ4_LAST_LITERALS && *m == *r) {
+            m++;
+            r++;
+        }
+        op = lz4_sequence(op, anchor, (size_t)(ip - anchor),
+                          (size_t)(ip - ref), (size_t)(m - ip));
+        ip = anchor = m;
+    }
+    op = lz4_sequence(op, anchor, (size_t)(end - anchor), 0, 0);
+    return (size_t)(op - dst);
+}
+
+/* writes the frame block of n bytes of src, uncompressed if it does not
+ * compress */
+static inline unsigned char *
+lz4_block(struct lz4_state *s, const unsigned char *src, size_t n,
+          unsigned char *op)
+{
+    size_t c = lz4_compress(s, src, n, op + 4);
+
+    if (c < n)
+        return lz4_write32(op, (uint32_t)c) + c;
+    op = lz4_write32(op, (uint32_t)n | 0x80000000U);
+    memcpy(op, src, n);
+    return op + n;
+}
+
+static inline void *
+lz4_init(const char *arg)
+{
+    struct lz4_state *s = malloc(sizeof(*s));
+    if (s == NULL) {
+        perror("transform malloc");
+        exit(EXIT_FAILURE);
+    }
+    return s;
+}
+
+/* compresses a group, in[0] is the first chunk of the group */
+static inline void
+lz4_process(void *state, const struct span *in, struct span *out,
+            unsigned int n)
+{
+    struct lz4_state *s = (struct lz4_state *)state;
+    unsigned char *op = s->buf;
+    size_t len = 0;
+
+    if (in[0].seq == 0)
+        op = (unsigned char *)memcpy(op, lz4_header, 7) + 7;
+    for (unsigned int i = 0; i < n; i++) {
+        memcpy(s->block + len, in[i].data, in[i].len);
+        len += in[i].len;
+    }
+    if (len > 0)
+        op = lz4_block(s, s->block, len, op);
+    if (in[n - 1].eof)
+        op = lz4_write32(op, 0);
+
+    /* spread the output over the chunks of the group */
+    size_t total = (size_t)(op - s->buf), done = 0;
+    for (unsigned int i = 0; i < n; i++) {
+        size_t room = lz4_bound(in[i].len);
+        out[i].len = total - done < room ? total - done : room;
+        memcpy(out[i].data, s->buf + done, out[i].len);
+        done += out[i].len;
+    }
+}
+
+static inline void
+no_fini(void *state)
+{
+}
+
+static const struct transform transforms[] = {
+    {"tr", "tr:SET1:SET2 maps bytes as tr, SET1 and SET2 may have a-z ranges",
+     false, 0, NULL, tr_init, tr_process, NULL, NULL, free},
+    {"lower", "lower maps ASCII letters to lower case", false, 0, NULL,
+     lower_init, fold_process, NULL, NULL, free},
+    {"upper", "upper maps ASCII letters to upper case", false, 0, NULL,
+     upper_init, fold_process, NULL, NULL, free},
+    {"escape", "escape shows control and non-ASCII bytes as cat -v", false, 0,
+     escape_bound, escape_init, escape_process, NULL, NULL, no_fini},
+    {"number", "number numbers all lines as cat -n", true, 0, number_bound,
+     number_all_init, number_process, NULL, NULL, free},
+    {"nonblank", "nonblank numbers non-empty lines as cat -b", true, 0,
+     number_bound, number_nonblank_init, number_process, NULL, NULL, free},
+    {"grep", "grep:PATTERN passes lines that contain PATTERN as grep -F", true,
+     0, grep_bound, grep_init, grep_process, grep_flush, NULL, grep_fini},
+    {"wc", "wc counts lines, words and bytes as wc instead of writing them",
+     false, 0, NULL, wc_init, wc_process, NULL, wc_reduce, wc_fini},
+    {"hex", "hex encodes bytes in hexadecimal as xxd -p", true, 0,
+     encode_bound, hex_init, encode_process, encode_flush, NULL, encode_fini},
+    {"base64", "base64 encodes bytes in base64 as base64", true, 0,
+     encode_bound, base64_init, encode_process, encode_flush, NULL,
+     encode_fini},
+    {"lz4", "lz4 compresses to an LZ4 frame, in parallel blocks", false,
+     LZ4_GROUP, lz4_bound, lz4_init, lz4_process, NULL, NULL, free},
+};
+
+#define NTRANSFORMS (sizeof(transforms) / sizeof(transforms[0]))
+
+/* finds a transform given as name[:arg], sets arg to NULL if there is none */
+static inline const struct transform *
+transform_find(const char *spec, const char **arg)
+{
+    size_t len = strcspn(spec, ":");
+
+    *arg = spec[len] == ':' ? spec + len + 1 : NULL;
+    for (size_t i = 0; i < NTRANSFORMS; i++)
+        if (strlen(transforms[i].name) == len &&
+            strncmp(transforms[i].name, spec, len) == 0)
+            return &transforms[i];
+    return NULL;
+}
+
+#endif
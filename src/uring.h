@@ -0,0 +1,275 @@
+/*
+ * Copyright (C) Huawei Technologies Co., Ltd. 2026. All rights reserved.
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef URING_H
+#define URING_H
+/*******************************************************************************
+ * Minimal io_uring wrapper talking directly to the kernel (no liburing).
+ *
+ * Each ring is owned by a single thread.  The submission and completion queue
+ * indices are shared with the kernel and accessed with vatomic operations.
+ * If io_uring is not available at compile time or at runtime, uring_init()
+ * fails and the caller is expected to fall back to plain read/write calls.
+ ******************************************************************************/
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <vsync/atomic.h>
+
+#if defined(__linux__) && defined(__has_include) && !defined(NO_URING)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#ifdef IORING_FEAT_RW_CUR_POS
+#define URING_SUPPORTED
+#endif
+#endif
+#endif
+
+#ifdef URING_SUPPORTED
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+struct uring {
+    int fd;
+    unsigned int entries;
+    unsigned int pending; /* prepared but not yet submitted sqes */
+
+    vatomic32_t *sq_head;
+    vatomic32_t *sq_tail;
+    unsigned int *sq_mask;
+    unsigned int *sq_array;
+    struct io_uring_sqe *sqes;
+
+    vatomic32_t *cq_head;
+    vatomic32_t *cq_tail;
+    unsigned int *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    void *sq_ptr;
+    void *cq_ptr;
+    size_t sq_len;
+    size_t cq_len;
+    size_t sqes_len;
+};
+
+static inline int
+uring_init(struct uring *u, unsigned int entries)
+{
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    memset(u, 0, sizeof(*u));
+
+    int fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (fd < 0)
+        return -errno;
+
+    /* we rely on offset -1 meaning "current file position" for writes */
+    if (!(p.features & IORING_FEAT_RW_CUR_POS)) {
+        close(fd);
+        return -ENOTSUP;
+    }
+
+    u->fd = fd;
+    u->entries = p.sq_entries;
+    u->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    u->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    u->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+
+    u->sq_ptr = mmap(0, u->sq_len, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    u->cq_ptr = mmap(0, u->cq_len, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    u->sqes = mmap(0, u->sqes_len, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (u->sq_ptr == MAP_FAILED || u->cq_ptr == MAP_FAILED ||
+        u->sqes == MAP_FAILED) {
+        int err = errno;
+        if (u->sq_ptr != MAP_FAILED)
+            munmap(u->sq_ptr, u->sq_len);
+        if (u->cq_ptr != MAP_FAILED)
+            munmap(u->cq_ptr, u->cq_len);
+        if (u->sqes != MAP_FAILED)
+            munmap(u->sqes, u->sqes_len);
+        close(fd);
+        return -err;
+    }
+
+    char *sq = (char *)u->sq_ptr;
+    u->sq_head = (vatomic32_t *)(sq + p.sq_off.head);
+    u->sq_tail = (vatomic32_t *)(sq + p.sq_off.tail);
+    u->sq_mask = (unsigned int *)(sq + p.sq_off.ring_mask);
+    u->sq_array = (unsigned int *)(sq + p.sq_off.array);
+
+    char *cq = (char *)u->cq_ptr;
+    u->cq_head = (vatomic32_t *)(cq + p.cq_off.head);
+    u->cq_tail = (vatomic32_t *)(cq + p.cq_off.tail);
+    u->cq_mask = (unsigned int *)(cq + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return 0;
+}
+
+static inline void
+uring_fini(struct uring *u)
+{
+    munmap(u->sqes, u->sqes_len);
+    munmap(u->cq_ptr, u->cq_len);
+    munmap(u->sq_ptr, u->sq_len);
+    close(u->fd);
+}
+
+/* registers the buffers used by uring_prep_rw() with a buffer index */
+static inline int
+uring_register_buffers(struct uring *u, const struct iovec *iov, unsigned int n)
+{
+    if (syscall(__NR_io_uring_register, u->fd, IORING_REGISTER_BUFFERS, iov,
+                n) < 0)
+        return -errno;
+    return 0;
+}
+
+/* prepares a fixed-buffer read or write, returns -EAGAIN if the sq is full */
+static inline int
+uring_prep_rw(struct uring *u, int op, int fd, void *buf, unsigned int len,
+              long long off, unsigned int buf_index, unsigned long long data,
+              unsigned int flags)
+{
+    unsigned int tail = vatomic32_read_rlx(u->sq_tail) + u->pending;
+    unsigned int head = vatomic32_read_acq(u->sq_head);
+
+    if (tail - head == u->entries)
+        return -EAGAIN;
+
+    unsigned int idx = tail & *u->sq_mask;
+    struct io_uring_sqe *sqe = &u->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = (unsigned char)op;
+    sqe->flags = (unsigned char)flags;
+    sqe->fd = fd;
+    sqe->off = (unsigned long long)off;
+    sqe->addr = (unsigned long long)(uintptr_t)buf;
+    sqe->len = len;
+    sqe->buf_index = (unsigned short)buf_index;
+    sqe->user_data = data;
+    u->sq_array[idx] = idx;
+    u->pending++;
+    return 0;
+}
+
+/* submits prepared sqes and waits for at least wait_nr completions */
+static inline int
+uring_submit(struct uring *u, unsigned int wait_nr)
+{
+    unsigned int tail = vatomic32_read_rlx(u->sq_tail) + u->pending;
+
+    vatomic32_write_rel(u->sq_tail, tail);
+    u->pending = 0;
+
+    /* also resubmit whatever the kernel did not consume on the last call */
+    unsigned int n = tail - vatomic32_read_acq(u->sq_head);
+    if (n == 0 && wait_nr == 0)
+        return 0;
+
+    for (;;) {
+        long r = syscall(__NR_io_uring_enter, u->fd, n, wait_nr,
+                         wait_nr ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if (r >= 0)
+            return (int)r;
+        if (errno != EINTR)
+            return -errno;
+        n = tail - vatomic32_read_acq(u->sq_head);
+    }
+}
+
+/* copies up to max completions into cqe and releases them to the kernel */
+static inline unsigned int
+uring_reap(struct uring *u, struct io_uring_cqe *cqe, unsigned int max)
+{
+    unsigned int head = vatomic32_read_rlx(u->cq_head);
+    unsigned int tail = vatomic32_read_acq(u->cq_tail);
+    unsigned int n = 0;
+
+    for (; head != tail && n < max; head++, n++)
+        cqe[n] = u->cqes[head & *u->cq_mask];
+
+    vatomic32_write_rel(u->cq_head, head);
+    return n;
+}
+
+#else /* !URING_SUPPORTED */
+
+#define IORING_OP_READ_FIXED 4
+#define IORING_OP_WRITE_FIXED 5
+#define IOSQE_IO_LINK (1U << 2)
+
+struct io_uring_cqe {
+    unsigned long long user_data;
+    int res;
+    unsigned int flags;
+};
+
+struct uring {
+    int fd;
+};
+
+static inline int
+uring_init(struct uring *u, unsigned int entries)
+{
+    (void)u;
+    (void)entries;
+    return -ENOSYS;
+}
+
+static inline void
+uring_fini(struct uring *u)
+{
+    (void)u;
+}
+
+static inline int
+uring_register_buffers(struct uring *u, const struct iovec *iov, unsigned int n)
+{
+    (void)u;
+    (void)iov;
+    (void)n;
+    return -ENOSYS;
+}
+
+static inline int
+uring_prep_rw(struct uring *u, int op, int fd, void *buf, unsigned int len,
+              long long off, unsigned int buf_index, unsigned long long data,
+              unsigned int flags)
+{
+    (void)u;
+    (void)op;
+    (void)fd;
+    (void)buf;
+    (void)len;
+    (void)off;
+    (void)buf_index;
+    (void)data;
+    (void)flags;
+    return -ENOSYS;
+}
+
+static inline int
+uring_submit(struct uring *u, unsigned int wait_nr)
+{
+    (void)u;
+    (void)wait_nr;
+    return -ENOSYS;
+}
+
+static inline unsigned int
+uring_reap(struct uring *u, struct io_uring_cqe *cqe, unsigned int max)
+{
+    (void)u;
+    (void)cqe;
+    (void)max;
+    return 0;
+}
+
+#endif /* !URING_SUPPORTED */
+#endif
@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) Huawei Technologies Co., Ltd. 2026. All rights reserved.
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef WAIT_H
+#define WAIT_H
+/*******************************************************************************
+ * Wait strategies for the loops that poll a ring until it has room or data.
+ *
+ * A thread keeps a waiter, calls wait_pause() after each failed poll and
+ * wait_done() once the poll succeeds.  The strategies are:
+ *
+ * - spin: poll again right away,
+ * - relax: poll again after a cpu relax hint (`pause` on x86, `yield` on Arm,
+ *   see vatomic_cpu_pause()), which frees pipeline resources for a sibling
+ *   hyperthread and saves power,
+ * - backoff: poll after 1, 2, 4, ... relax hints, up to WAIT_MAX_BACKOFF,
+ * - yield: give the cpu to another thread with sched_yield() between polls,
+ * - adaptive: relax for up to `budget` polls, then yield, and after
+ *   WAIT_MAX_YIELD yields sleep WAIT_SLEEP_NS between polls, so that a thread
+ *   left idle, as behind a followed file, does not keep a cpu busy when no
+ *   other thread wants it.  The budget follows the recent waits: a wait that
+ *   ends while relaxing pulls the budget towards twice its length, a wait that
+ *   has to yield halves it, so threads whose waits are short spin through them
+ *   and threads whose waits are long get off the cpu early.
+ *
+ * The loops are libvsync await loops, await_while() as in the vatomic await
+ * functions, so that a model checker sees them as such with
+ * VSYNC_VERIFICATION, and the relax hint is vatomic_cpu_pause().  The await
+ * functions themselves wait for one atomic to change, while our loops poll a
+ * ring operation, which has an effect once it succeeds, so the policies run
+ * in the body of the loop instead.
+ *
+ * A thread that calls wait_track() traces its waits when tracing is on, see
+ * trace.h, and with -DSTATS also counts them, their time and their polls, see
+ * stats.h.
+ ******************************************************************************/
+#include <sched.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <vsync/atomic.h>
+#include <vsync/common/await_while.h>
+
+#include "stats.h"
+#include "trace.h"
+
+#define WAIT_MAX_BACKOFF 1024
+#define WAIT_MIN_SPIN 16
+#define WAIT_MAX_SPIN 16384
+#define WAIT_MAX_YIELD 1024
+#define WAIT_SLEEP_NS 100000
+
+enum wait_policy {
+    WAIT_SPIN,
+    WAIT_RELAX,
+    WAIT_BACKOFF,
+    WAIT_YIELD,
+    WAIT_ADAPTIVE,
+};
+#define WAIT_POLICIES 5
+
+static const char *wait_names[WAIT_POLICIES] = {"spin", "relax", "backoff",
+                                                "yield", "adaptive"};
+
+struct waiter {
+    enum wait_policy policy;
+    unsigned int polls;      /* failed polls in the current wait */
+    unsigned int delay;      /* relax hints before the next poll, for backoff */
+    unsigned int budget;     /* polls to relax before yielding, for adaptive */
+    struct trace_buf *trace; /* NULL if the waits are not traced */
+#ifdef STATS
+    struct stats_stage *stats; /* NULL if the waits are not counted */
+#endif
+};
+
+/* returns true if a thread that waits with policy gets off its cpu, as it
+ * must with SCHED_FIFO, which the other threads of the cpu cannot preempt */
+static inline bool
+wait_yields(enum wait_policy policy)
+{
+    return policy == WAIT_YIELD || policy == WAIT_ADAPTIVE;
+}
+
+/* returns the policy with the given name, or -1 */
+static inline int
+wait_find(const char *name)
+{
+    for (int i = 0; i < WAIT_POLICIES; i++)
+        if (strcmp(name, wait_names[i]) == 0)
+            return i;
+    return -1;
+}
+
+static inline void
+wait_init(struct waiter *w, enum wait_policy policy)
+{
+    w->policy = policy;
+    w->polls = 0;
+    w->delay = 1;
+    w->budget = 4 * WAIT_MIN_SPIN;
+    w->trace = NULL;
+#ifdef STATS
+    w->stats = NULL;
+#endif
+}
+
+/* traces and counts the waits of the calling thread as those of stage name
+ * id, whose life begins */
+static inline void
+wait_track(struct waiter *w, const char *name, unsigned int id)
+{
+    w->trace = trace_thread(name, id);
+    trace_begin(w->trace, TRACE_STAGE, 0);
+#ifdef STATS
+    w->stats = stats_stage_new(name, id);
+#endif
+}
+
+/* the thread of a tracked waiter is done */
+static inline void
+wait_untrack(struct waiter *w)
+{
+    trace_end(w->trace, TRACE_STAGE);
+#ifdef STATS
+    stats_stage_end(w->stats);
+#endif
+}
+
+/* waits after a failed poll */
+static inline void
+wait_pause(struct waiter *w)
+{
+    if (w->polls++ == 0) {
+        trace_begin(w->trace, TRACE_WAIT, 0);
+        stats_wait_begin(w->stats);
+    }
+    switch (w->policy) {
+    case WAIT_SPIN:
+        break;
+    case WAIT_RELAX:
+        vatomic_cpu_pause();
+        break;
+    case WAIT_BACKOFF:
+        for (unsigned int i = 0; i < w->delay; i++)
+            vatomic_cpu_pause();
+        if (w->delay < WAIT_MAX_BACKOFF)
+            w->delay *= 2;
+        break;
+    case WAIT_YIELD:
+        sched_yield();
+        break;
+    case WAIT_ADAPTIVE:
+        if (w->polls <= w->budget)
+            vatomic_cpu_pause();
+        else if (w->polls <= w->budget + WAIT_MAX_YIELD)
+            sched_yield();
+        else
+            nanosleep(&(struct timespec){0, WAIT_SLEEP_NS}, NULL);
+        break;
+    }
+}
+
+/* ends a wait, if there was one */
+static inline void
+wait_done(struct waiter *w)
+{
+    if (w->polls == 0)
+        return;
+    trace_end(w->trace, TRACE_WAIT);
+    stats_wait_end(w->stats, w->polls);
+    if (w->policy == WAIT_ADAPTIVE) {
+        if (w->polls <= w->budget) {
+            unsigned int target = 2 * w->polls;
+            if (target > WAIT_MAX_SPIN)
+                target = WAIT_MAX_SPIN;
+            w->budget = w->budget - w->budget / 8 + target / 8;
+        } else {
+            w->budget /= 2;
+        }
+        if (w->budget < WAIT_MIN_SPIN)
+            w->budget = WAIT_MIN_SPIN;
+    }
+    w->polls = 0;
+    w->delay = 1;
+}
+
+/* polls until cond is false, waiting with w in between */
+#define wait_while(w, cond)                                                    \
+    do {                                                                       \
+        await_while (cond)                                                     \
+            wait_pause(w);                                                     \
+        wait_done(w);                                                          \
+    } while (0)
+
+#endif